@@ -5,35 +5,64 @@ from __future__ import annotations
 import atexit
 import json
 import logging
+import re
+import struct
 import threading
 import time
-from collections import deque
 from itertools import islice
 from datetime import datetime, timezone
-from typing import Any, Dict, Optional
+from typing import Any, Dict, List, Optional, Tuple
 from uuid import uuid4
 
-from flask import Flask, jsonify, render_template, request
+from flask import Flask, Response, jsonify, render_template, request
 
+import msgpack
 import paho.mqtt.client as mqtt
 
+from device_store import DeviceState, DeviceStore
+from event_stream import EventHub, stream
+
 
 MQTT_BROKER = "mqtt.iotserver.uz"
 MQTT_PORT = 1883
 MQTT_USERNAME = "userTTPU"
 MQTT_PASSWORD = "mqttpass"
-TOPIC_LIGHT = "ttpu/iot/maqsud/sensors/light"
-TOPIC_BUTTON = "ttpu/iot/maqsud/events/button"
-TOPIC_LEDS = {
-	"red": "ttpu/iot/maqsud/led/red",
-	"green": "ttpu/iot/maqsud/led/green",
-	"blue": "ttpu/iot/maqsud/led/blue",
-	"yellow": "ttpu/iot/maqsud/led/yellow",
-}
-TOPIC_DISPLAY = "ttpu/iot/maqsud/display"
+# Every node publishes under TOPIC_ROOT/<device id>/...; the dashboard follows
+# all of them through wildcard subscriptions and keeps state per device
+TOPIC_ROOT = "ttpu/iot"
+DEFAULT_DEVICE = "maqsud"
+LED_COLORS = ["red", "green", "blue", "yellow"]
+SUFFIX_LIGHT = "sensors/light"
+SUFFIX_BUTTON = "events/button"
+SUFFIX_LED = "led"
+# Combined command: {"red":"ON","blue":"OFF",...} or {"mask":N}, bit i = i-th LED above
+SUFFIX_LED_ALL = "led/all"
+SUFFIX_DISPLAY = "display"
+SUFFIX_METRICS = "metrics"
 LIGHT_MAX = 4096
 MAX_EVENT_HISTORY = 25
 VALID_LED_STATES = {"ON", "OFF"}
+DEVICE_ID_PATTERN = re.compile(r"^[A-Za-z0-9_-]{1,64}$")  # one topic level, no wildcards
+
+# Device store sizing: 1 s light history for an hour per device
+STORE_SHARDS = 16
+MAX_DEVICES = 1024
+HISTORY_POINTS = 3600
+# Frames queued per open dashboard stream before it is resynced with a snapshot
+STREAM_MAX_PENDING = 64
+
+# Fixed-layout telemetry records (firmware TELEMETRY_ENCODING_PACKED)
+PACKED_MAGIC = 0xC1
+PACKED_LIGHT_BATCH_V1 = 0x01  # u32 uptime timestamps, no sequence numbers
+PACKED_BUTTON_EVENT_V1 = 0x02
+PACKED_LIGHT_BATCH = 0x03
+PACKED_BUTTON_EVENT = 0x04
+_PACKED_LIGHT_SAMPLE = struct.Struct("<HHHHI")  # light, min, max, ema, timestamp/offset
+_PACKED_BUTTON_V1 = struct.Struct("<BI")
+_PACKED_SEQ_TIMESTAMP = struct.Struct("<BIQ")  # count/pressed, seq, epoch ms
+
+# Firmware timestamps below this are ms since boot (clock not synced yet)
+EPOCH_MS_MIN = 1e11
 
 
 logging.basicConfig(
@@ -46,17 +75,21 @@ logger = logging.getLogger("dashboard")
 app = Flask(__name__, static_folder="static", template_folder="templates")
 
 
-state_lock = threading.Lock()
-latest_sensor: Dict[str, Optional[float]] = {"light": None, "timestamp": None}
-button_events: deque[Dict[str, Any]] = deque(maxlen=MAX_EVENT_HISTORY)
+def _new_device(device_id: str) -> DeviceState:
+	return DeviceState(device_id, LED_COLORS, HISTORY_POINTS, MAX_EVENT_HISTORY)
+
+
+store = DeviceStore(_new_device, shards=STORE_SHARDS, max_devices=MAX_DEVICES)
+hub = EventHub(max_pending=STREAM_MAX_PENDING)
+
+# Broker connection, shared by all devices. last_message_at is written by the
+# MQTT thread on every message without a lock (a single reference store).
+connection_lock = threading.Lock()
 connection_state: Dict[str, Any] = {
 	"connected": False,
 	"last_error": None,
-	"last_message_at": None,
 }
-
-led_states: Dict[str, str] = {color: "OFF" for color in TOPIC_LEDS}
-last_display_message: Dict[str, Any] = {"text": "", "timestamp": None}
+last_message_at: Optional[float] = None
 
 
 mqtt_start_lock = threading.Lock()
@@ -65,14 +98,23 @@ mqtt_client: Optional[mqtt.Client] = None
 
 
 def _safe_timestamp(raw: Any) -> Optional[float]:
-	"""Convert raw timestamp values to float seconds since epoch when possible."""
+	"""Convert raw timestamp values to float seconds since epoch when possible.
+
+	Firmware sends epoch milliseconds once its clock has synced and ms since
+	boot before that; the latter cannot be placed in time, so they map to None.
+	"""
 
-	if raw is None:
+	if raw is None or isinstance(raw, bool):
 		return None
 	try:
-		return float(raw)
+		value = float(raw)
 	except (TypeError, ValueError):
 		return None
+	if value >= EPOCH_MS_MIN:
+		return value / 1000.0
+	if value >= 1e9:
+		return value  # already epoch seconds
+	return None
 
 
 def _to_iso(timestamp: Optional[float]) -> Optional[str]:
@@ -84,123 +126,331 @@ def _to_iso(timestamp: Optional[float]) -> Optional[str]:
 		return None
 
 
-def _handle_light_payload(payload: Dict[str, Any]) -> None:
-	light_value = payload.get("light")
-	if not isinstance(light_value, (int, float)):
-		logger.warning("Unexpected light payload: %s", payload)
-		return
+def _decode_packed(raw: bytes) -> Any:
+	"""Decode a packed telemetry record into the same shape as its JSON form."""
 
-	timestamp = _safe_timestamp(payload.get("timestamp")) or time.time()
-	clamped = max(0.0, min(float(light_value), float(LIGHT_MAX)))
-	with state_lock:
-		latest_sensor["light"] = clamped
-		latest_sensor["timestamp"] = timestamp
+	if len(raw) < 2:
+		raise ValueError("truncated packed record")
+	kind = raw[1]
+	if kind == PACKED_LIGHT_BATCH:
+		count, first_seq, first_timestamp = _PACKED_SEQ_TIMESTAMP.unpack_from(raw, 2)
+		offset = 2 + _PACKED_SEQ_TIMESTAMP.size
+		body = raw[offset:offset + count * _PACKED_LIGHT_SAMPLE.size]
+		if len(body) != count * _PACKED_LIGHT_SAMPLE.size:
+			raise ValueError("truncated light batch")
+		return [
+			{
+				"seq": first_seq + i,
+				"light": light,
+				"min": low,
+				"max": high,
+				"ema": ema,
+				"timestamp": first_timestamp + offset_ms,
+			}
+			for i, (light, low, high, ema, offset_ms) in enumerate(_PACKED_LIGHT_SAMPLE.iter_unpack(body))
+		]
+	if kind == PACKED_BUTTON_EVENT:
+		pressed, seq, timestamp = _PACKED_SEQ_TIMESTAMP.unpack_from(raw, 2)
+		return {"seq": seq, "event": "pressed" if pressed else "released", "timestamp": timestamp}
+	if kind == PACKED_LIGHT_BATCH_V1:
+		count = raw[2] if len(raw) > 2 else 0
+		body = raw[3:3 + count * _PACKED_LIGHT_SAMPLE.size]
+		if len(body) != count * _PACKED_LIGHT_SAMPLE.size:
+			raise ValueError("truncated light batch")
+		return [
+			{"light": light, "min": low, "max": high, "ema": ema, "timestamp": timestamp}
+			for light, low, high, ema, timestamp in _PACKED_LIGHT_SAMPLE.iter_unpack(body)
+		]
+	if kind == PACKED_BUTTON_EVENT_V1:
+		pressed, timestamp = _PACKED_BUTTON_V1.unpack_from(raw, 2)
+		return {"event": "pressed" if pressed else "released", "timestamp": timestamp}
+	raise ValueError(f"unknown packed record type {kind}")
+
+
+def _decode_payload(raw: bytes) -> Any:
+	"""Decode JSON, MessagePack or packed telemetry, told apart by the first byte."""
+
+	stripped = raw.lstrip()
+	if not stripped:
+		raise ValueError("empty payload")
+	first = stripped[0]
+	if first in b"{[":
+		return json.loads(stripped.decode("utf-8"))
+	if first == PACKED_MAGIC:
+		return _decode_packed(raw)
+	return msgpack.unpackb(raw, raw=False)
+
+
+def _device_topic(device_id: str, suffix: str) -> str:
+	return f"{TOPIC_ROOT}/{device_id}/{suffix}"
+
+
+def _device_topics(device_id: str) -> Dict[str, Any]:
+	return {
+		"light": _device_topic(device_id, SUFFIX_LIGHT),
+		"button": _device_topic(device_id, SUFFIX_BUTTON),
+		"leds": {color: _device_topic(device_id, f"{SUFFIX_LED}/{color}") for color in LED_COLORS},
+		"led_all": _device_topic(device_id, SUFFIX_LED_ALL),
+		"display": _device_topic(device_id, SUFFIX_DISPLAY),
+		"metrics": _device_topic(device_id, SUFFIX_METRICS),
+	}
+
+
+def _parse_topic(topic: str) -> Optional[Tuple[str, str]]:
+	"""Split TOPIC_ROOT/<device>/<suffix> into (device, suffix)."""
+
+	prefix = TOPIC_ROOT + "/"
+	if not topic.startswith(prefix):
+		return None
+	device_id, _, suffix = topic[len(prefix):].partition("/")
+	if not suffix or not DEVICE_ID_PATTERN.match(device_id):
+		return None
+	return device_id, suffix
+
+
+def _clamp_light(value: float) -> float:
+	return max(0.0, min(float(value), float(LIGHT_MAX)))
+
+
+# Payload handlers run in the MQTT thread with the device's shard lock held;
+# each returns whether it changed the device
+
+
+def _handle_light_payload(device: DeviceState, payload: Any) -> bool:
+	# Firmware publishes either one sample or a batch (JSON array of samples)
+	samples = payload if isinstance(payload, list) else [payload]
+	latest: Optional[Dict[str, Optional[float]]] = None
+	for sample in samples:
+		light_value = sample.get("light") if isinstance(sample, dict) else None
+		if not isinstance(light_value, (int, float)):
+			logger.warning("Unexpected light payload from %s: %s", device.device_id, sample)
+			continue
+
+		timestamp = _safe_timestamp(sample.get("timestamp")) or time.time()
+		device.history.append(timestamp, _clamp_light(light_value))
+		if latest is None or timestamp >= latest["timestamp"]:
+			latest = {"light": _clamp_light(light_value), "timestamp": timestamp}
+			# Window statistics are optional (older firmware sends only "light")
+			for key in ("min", "max", "ema"):
+				value = sample.get(key)
+				latest[key] = _clamp_light(value) if isinstance(value, (int, float)) else None
+
+	if latest is None:
+		return False
+	device.sensor.update(latest)
+	return True
 
 
-def _handle_button_payload(payload: Dict[str, Any]) -> None:
-	event_raw = payload.get("event")
+def _handle_button_payload(device: DeviceState, payload: Any) -> bool:
+	event_raw = payload.get("event") if isinstance(payload, dict) else None
 	if not isinstance(event_raw, str):
-		logger.warning("Unexpected button payload: %s", payload)
-		return
+		logger.warning("Unexpected button payload from %s: %s", device.device_id, payload)
+		return False
 	event = event_raw.strip().upper()
 	if event not in {"PRESSED", "RELEASED"}:
-		logger.warning("Unknown button event '%s'", event_raw)
-		return
+		logger.warning("Unknown button event '%s' from %s", event_raw, device.device_id)
+		return False
 
 	timestamp = _safe_timestamp(payload.get("timestamp")) or time.time()
-	entry = {
+	seq = payload.get("seq")
+	device.button_events.appendleft({
 		"event": event,
+		"seq": seq if isinstance(seq, int) and not isinstance(seq, bool) else None,
 		"timestamp": timestamp,
-	}
-	with state_lock:
-		button_events.appendleft(entry)
+	})
+	return True
 
 
-def _handle_led_payload(topic: str, payload: Dict[str, Any]) -> None:
-	state_raw = payload.get("state")
+def _handle_led_payload(device: DeviceState, color: str, payload: Any) -> bool:
+	state_raw = payload.get("state") if isinstance(payload, dict) else None
 	if not isinstance(state_raw, str):
-		logger.warning("Unexpected LED payload on %s: %s", topic, payload)
-		return
+		logger.warning("Unexpected LED payload for %s/%s: %s", device.device_id, color, payload)
+		return False
 	state = state_raw.strip().upper()
 	if state not in VALID_LED_STATES:
-		logger.warning("Unknown LED state '%s' on %s", state_raw, topic)
-		return
-	color = next((name for name, topic_name in TOPIC_LEDS.items() if topic_name == topic), None)
-	if color is None:
-		return
-	with state_lock:
-		led_states[color] = state
+		logger.warning("Unknown LED state '%s' for %s/%s", state_raw, device.device_id, color)
+		return False
+	if color not in device.leds:
+		return False
+	device.leds[color] = state
+	return True
+
+
+def _handle_led_scene_payload(device: DeviceState, payload: Any) -> bool:
+	if not isinstance(payload, dict):
+		logger.warning("Unexpected LED scene payload for %s: %s", device.device_id, payload)
+		return False
+	mask = payload.get("mask")
+	if isinstance(mask, int) and not isinstance(mask, bool):
+		for bit, color in enumerate(LED_COLORS):
+			device.leds[color] = "ON" if mask & (1 << bit) else "OFF"
+	for color in LED_COLORS:
+		state = payload.get(color)
+		if isinstance(state, str) and state in VALID_LED_STATES:
+			device.leds[color] = state
+	return True
+
+
+def _handle_display_payload(device: DeviceState, payload: Any) -> bool:
+	text_raw = payload.get("text") if isinstance(payload, dict) else None
+	if not isinstance(text_raw, str):
+		logger.warning("Unexpected display payload for %s: %s", device.device_id, payload)
+		return False
+	device.display.update({"text": text_raw[:16], "timestamp": time.time()})
+	return True
 
 
-def _handle_display_payload(payload: Dict[str, Any]) -> None:
-	text_raw = payload.get("text")
-	if not isinstance(text_raw, str):
-		logger.warning("Unexpected display payload: %s", payload)
+def _handle_metrics_payload(device: DeviceState, payload: Any) -> bool:
+	if not isinstance(payload, dict):
+		logger.warning("Unexpected metrics payload from %s: %s", device.device_id, payload)
+		return False
+	device.metrics.update({"data": payload, "received_at": time.time()})
+	return True
+
+
+# JSON views of a device's state, shared by /api/state and the event stream.
+# Called with the shard lock held, so they copy what they return.
+
+
+def _sensor_view(sensor: Dict[str, Optional[float]]) -> Optional[Dict[str, Any]]:
+	if sensor["light"] is None:
+		return None
+	return dict(sensor, timestamp_iso=_to_iso(sensor["timestamp"]))
+
+
+def _event_view(entry: Dict[str, Any]) -> Dict[str, Any]:
+	return dict(entry, timestamp_iso=_to_iso(entry["timestamp"]))
+
+
+def _display_view(display: Dict[str, Any]) -> Dict[str, Any]:
+	return {
+		"text": display.get("text", ""),
+		"timestamp": display.get("timestamp"),
+		"timestamp_iso": _to_iso(display.get("timestamp")),
+	}
+
+
+def _metrics_view(metrics: Dict[str, Any]) -> Dict[str, Any]:
+	return {
+		"data": metrics["data"],
+		"received_at": metrics["received_at"],
+		"received_at_iso": _to_iso(metrics["received_at"]),
+	}
+
+
+def _publish_led_states(device_id: str, snapshot: Dict[str, str]) -> None:
+	"""Publishes the full LED state as one retained combined command."""
+
+	if mqtt_client is None:
+		logger.warning("LED update requested before MQTT client ready")
 		return
-	text = text_raw[:16]
-	with state_lock:
-		last_display_message.update({"text": text, "timestamp": time.time()})
+	try:
+		mqtt_client.publish(_device_topic(device_id, SUFFIX_LED_ALL), payload=json.dumps(snapshot), qos=1, retain=True)
+	except Exception as exc:  # pylint: disable=broad-except
+		logger.exception("Failed to publish LED states: %s", exc)
+
+
+def _retained_commands(device: DeviceState) -> Optional[Tuple[str, Dict[str, str], str]]:
+	if not device.commanded and device.device_id != DEFAULT_DEVICE:
+		return None
+	return device.device_id, dict(device.leds), device.display.get("text", "")
+
+
+def _set_connection(connected: bool, last_error: Optional[str]) -> None:
+	with connection_lock:
+		connection_state.update({"connected": connected, "last_error": last_error})
+	hub.broadcast("delta", {"connection": {"connected": connected, "last_error": last_error}})
 
 
 def _on_connect(client: mqtt.Client, _userdata: Any, _flags: Dict[str, Any], rc: int) -> None:
 	if rc == 0:
 		logger.info("Connected to MQTT broker %s", MQTT_BROKER)
-		client.subscribe([(TOPIC_LIGHT, 0), (TOPIC_BUTTON, 0)])
-		client.subscribe([(topic, 0) for topic in TOPIC_LEDS.values()])
-		client.subscribe([(TOPIC_DISPLAY, 0)])
-		with state_lock:
-			connection_state.update({"connected": True, "last_error": None})
-			led_snapshot = dict(led_states)
-			display_snapshot = dict(last_display_message)
-		for color, state in led_snapshot.items():
+		suffixes = (SUFFIX_LIGHT, SUFFIX_BUTTON, f"{SUFFIX_LED}/+", SUFFIX_DISPLAY, SUFFIX_METRICS)
+		client.subscribe([(_device_topic("+", suffix), 0) for suffix in suffixes])
+		_set_connection(True, None)
+
+		# Republish what the dashboard has commanded (and the default node's
+		# state, which it owns from the start)
+		with store.device(DEFAULT_DEVICE):
+			pass
+		for retained in store.each(_retained_commands):
+			if retained is None:
+				continue
+			device_id, led_snapshot, display_text = retained
 			try:
-				client.publish(TOPIC_LEDS[color], json.dumps({"state": state}), qos=1, retain=True)
+				# All LEDs live in one retained message; clear the per-LED ones so
+				# a (re)subscribing node does not replay stale states after it
+				for color in LED_COLORS:
+					client.publish(_device_topic(device_id, f"{SUFFIX_LED}/{color}"), b"", qos=1, retain=True)
+				client.publish(_device_topic(device_id, SUFFIX_LED_ALL), json.dumps(led_snapshot), qos=1, retain=True)
 			except Exception as exc:  # pylint: disable=broad-except
-				logger.debug("Failed to publish retained LED state for %s: %s", color, exc)
-		if display_snapshot.get("text"):
-			try:
-				client.publish(TOPIC_DISPLAY, json.dumps({"text": display_snapshot["text"]}), qos=1, retain=True)
-			except Exception as exc:  # pylint: disable=broad-except
-				logger.debug("Failed to publish retained display text: %s", exc)
+				logger.debug("Failed to publish retained LED states: %s", exc)
+			if display_text:
+				try:
+					client.publish(_device_topic(device_id, SUFFIX_DISPLAY), json.dumps({"text": display_text}), qos=1, retain=True)
+				except Exception as exc:  # pylint: disable=broad-except
+					logger.debug("Failed to publish retained display text: %s", exc)
 	else:
 		logger.error("MQTT connection failed with code %s", rc)
-		with state_lock:
-			connection_state.update({
-				"connected": False,
-				"last_error": f"Connection failed (code {rc})",
-			})
+		_set_connection(False, f"Connection failed (code {rc})")
 
 
 def _on_message(client: mqtt.Client, _userdata: Any, msg: mqtt.MQTTMessage) -> None:
+	global last_message_at
+	if not msg.payload:
+		return  # a retained message being cleared
+	parsed = _parse_topic(msg.topic)
+	if parsed is None:
+		logger.debug("Unhandled topic %s", msg.topic)
+		return
+	device_id, suffix = parsed
+	led_color = suffix[len(SUFFIX_LED) + 1:] if suffix.startswith(SUFFIX_LED + "/") else None
+	if suffix not in (SUFFIX_LIGHT, SUFFIX_BUTTON, SUFFIX_DISPLAY, SUFFIX_METRICS) and led_color is None:
+		logger.debug("Unhandled topic %s", msg.topic)
+		return
 	try:
-		payload = json.loads(msg.payload.decode("utf-8"))
-	except json.JSONDecodeError:
+		payload = _decode_payload(msg.payload)
+	except (ValueError, struct.error, msgpack.UnpackException):
 		logger.warning("Failed to decode MQTT payload on %s", msg.topic)
 		return
 
-	if msg.topic == TOPIC_LIGHT:
-		_handle_light_payload(payload)
-	elif msg.topic == TOPIC_BUTTON:
-		_handle_button_payload(payload)
-	elif msg.topic in TOPIC_LEDS.values():
-		_handle_led_payload(msg.topic, payload)
-	elif msg.topic == TOPIC_DISPLAY:
-		_handle_display_payload(payload)
-	else:
-		logger.debug("Unhandled topic %s", msg.topic)
-
-	with state_lock:
-		connection_state["last_message_at"] = time.time()
+	now = time.time()
+	# Only the part of the state this message changed is pushed to the
+	# browsers watching the device, copied while the shard lock is held
+	delta: Dict[str, Any] = {}
+	with store.device(device_id) as device:
+		if device is None:
+			logger.debug("Device store full, ignoring %s", device_id)
+			return
+		if suffix == SUFFIX_LIGHT:
+			if _handle_light_payload(device, payload):
+				delta["sensor"] = _sensor_view(device.sensor)
+		elif suffix == SUFFIX_BUTTON:
+			if _handle_button_payload(device, payload):
+				delta["event"] = _event_view(device.button_events[0])
+		elif suffix == SUFFIX_LED_ALL:
+			if _handle_led_scene_payload(device, payload):
+				delta["leds"] = dict(device.leds)
+		elif led_color is not None:
+			if _handle_led_payload(device, led_color, payload):
+				delta["leds"] = dict(device.leds)
+		elif suffix == SUFFIX_DISPLAY:
+			if _handle_display_payload(device, payload):
+				delta["display"] = _display_view(device.display)
+		elif suffix == SUFFIX_METRICS:
+			if _handle_metrics_payload(device, payload):
+				delta["metrics"] = _metrics_view(device.metrics)
+		device.last_message_at = now
+	last_message_at = now
+
+	delta["connection"] = {"last_message_at": now, "last_message_at_iso": _to_iso(now)}
+	hub.publish(device_id, "delta", delta)
 
 
 def _on_disconnect(client: mqtt.Client, _userdata: Any, rc: int) -> None:
 	reason = "clean" if rc == 0 else f"unexpected (code {rc})"
 	logger.warning("Disconnected from MQTT broker: %s", reason)
-	with state_lock:
-		connection_state.update({
-			"connected": False,
-			"last_error": None if rc == 0 else f"Disconnected (code {rc})",
-		})
+	_set_connection(False, None if rc == 0 else f"Disconnected (code {rc})")
 
 
 def _build_mqtt_client() -> mqtt.Client:
@@ -228,7 +478,7 @@ def start_mqtt() -> None:
 			logger.info("Started MQTT listener thread")
 		except Exception as exc:  # pylint: disable=broad-except
 			logger.exception("Unable to start MQTT client: %s", exc)
-			with state_lock:
+			with connection_lock:
 				connection_state.update({
 					"connected": False,
 					"last_error": str(exc),
@@ -255,77 +505,140 @@ def _shutdown_mqtt() -> None:
 start_mqtt()
 
 
+def _request_device() -> Optional[str]:
+	"""The ?device= query argument (the default node if absent), or None if invalid."""
+
+	device_id = request.args.get("device", DEFAULT_DEVICE)
+	return device_id if DEVICE_ID_PATTERN.match(device_id) else None
+
+
 @app.route("/")
 def index() -> str:
+	device_id = _request_device() or DEFAULT_DEVICE
 	context = {
 		"mqtt_broker": MQTT_BROKER,
-		"topics": {
-			"light": TOPIC_LIGHT,
-			"button": TOPIC_BUTTON,
-			"leds": TOPIC_LEDS,
-			"display": TOPIC_DISPLAY,
-		},
+		"device": device_id,
+		"topics": _device_topics(device_id),
 	}
 	return render_template("index.html", **context)
 
 
-@app.route("/api/state")
-def get_state() -> Any:
-	with state_lock:
-		sensor_data = None
-		if latest_sensor["light"] is not None:
-			sensor_data = {
-				"light": latest_sensor["light"],
-				"timestamp": latest_sensor["timestamp"],
-				"timestamp_iso": _to_iso(latest_sensor["timestamp"]),
-			}
-
-		events = [
-			{
-				"event": entry["event"],
-				"timestamp": entry["timestamp"],
-				"timestamp_iso": _to_iso(entry["timestamp"]),
-			}
-			for entry in islice(button_events, 6)
-		]
-
-		connection_snapshot = {
-			"connected": connection_state["connected"],
-			"last_error": connection_state["last_error"],
-			"last_message_at": connection_state["last_message_at"],
-			"last_message_at_iso": _to_iso(connection_state["last_message_at"]),
-		}
-
-		led_snapshot = dict(led_states)
-		display_snapshot = dict(last_display_message)
-
-	payload = {
+def _state_snapshot(device_id: str) -> Dict[str, Any]:
+	"""Everything the dashboard shows for one device (empty if it is unknown)."""
+
+	with connection_lock:
+		connected = connection_state["connected"]
+		last_error = connection_state["last_error"]
+
+	sensor_data = None
+	events: List[Dict[str, Any]] = []
+	led_snapshot = {color: "OFF" for color in LED_COLORS}
+	display_snapshot = _display_view({})
+	metrics_snapshot = _metrics_view({"data": None, "received_at": None})
+	device_last_message_at = None
+	with store.device(device_id, create=False) as device:
+		if device is not None:
+			sensor_data = _sensor_view(device.sensor)
+			events = [_event_view(entry) for entry in islice(device.button_events, 6)]
+			led_snapshot = dict(device.leds)
+			display_snapshot = _display_view(device.display)
+			metrics_snapshot = _metrics_view(device.metrics)
+			device_last_message_at = device.last_message_at
+
+	return {
+		"device": device_id,
 		"sensor": sensor_data,
 		"events": events,
-		"connection": connection_snapshot,
-		"leds": led_snapshot,
-		"display": {
-			"text": display_snapshot.get("text", ""),
-			"timestamp": display_snapshot.get("timestamp"),
-			"timestamp_iso": _to_iso(display_snapshot.get("timestamp")),
+		"connection": {
+			"connected": connected,
+			"last_error": last_error,
+			"last_message_at": device_last_message_at,
+			"last_message_at_iso": _to_iso(device_last_message_at),
 		},
+		"leds": led_snapshot,
+		"display": display_snapshot,
+		"metrics": metrics_snapshot,
 		"meta": {
-			"topics": {
-				"light": TOPIC_LIGHT,
-				"button": TOPIC_BUTTON,
-				"leds": TOPIC_LEDS,
-				"display": TOPIC_DISPLAY,
-			},
+			"topics": _device_topics(device_id),
 			"light_max": LIGHT_MAX,
 		},
 	}
-	return jsonify(payload)
+
+
+@app.route("/api/state")
+def get_state() -> Any:
+	device_id = _request_device()
+	if device_id is None:
+		return jsonify({"error": "Invalid device id"}), 400
+	return jsonify(_state_snapshot(device_id))
+
+
+@app.route("/api/stream")
+def stream_state() -> Any:
+	"""Server-sent events for ?device=: a "state" snapshot, then "delta" events.
+
+	A delta carries only the keys of /api/state that changed ("sensor",
+	"leds", "display", "metrics", "connection"), except that a new button
+	event arrives alone as "event" for the client to prepend to "events".
+	"""
+
+	device_id = _request_device()
+	if device_id is None:
+		return jsonify({"error": "Invalid device id"}), 400
+
+	_ensure_mqtt_running()
+	return Response(
+		stream(hub, device_id, lambda: _state_snapshot(device_id)),
+		mimetype="text/event-stream",
+		headers={"Cache-Control": "no-cache", "X-Accel-Buffering": "no"},
+	)
+
+
+def _device_summary(device: DeviceState) -> Dict[str, Any]:
+	return {
+		"id": device.device_id,
+		"light": device.sensor["light"],
+		"last_message_at": device.last_message_at,
+	}
+
+
+@app.route("/api/devices")
+def list_devices() -> Any:
+	devices = sorted(store.each(_device_summary), key=lambda summary: summary["id"])
+	for summary in devices:
+		summary["last_message_at_iso"] = _to_iso(summary["last_message_at"])
+	return jsonify({
+		"devices": devices,
+		"count": len(devices),
+		"last_message_at": last_message_at,
+		"last_message_at_iso": _to_iso(last_message_at),
+	})
+
+
+@app.route("/api/devices/<device_id>/history")
+def get_device_history(device_id: str) -> Any:
+	"""Light history at 1 s resolution: ?since=<epoch s> for new points only, ?limit=N."""
+
+	since = request.args.get("since", 0.0, type=float)
+	limit = request.args.get("limit", None, type=int)
+	if limit is not None and limit <= 0:
+		return jsonify({"error": "'limit' must be positive"}), 400
+
+	with store.device(device_id, create=False) as device:
+		if device is None:
+			return jsonify({"error": "Unknown device"}), 404
+		points = device.history.query(since, limit)
+
+	return jsonify({"device": device_id, "light": [[ts, value] for ts, value in points]})
 
 
 @app.route("/api/led/<color>", methods=["POST"])
 def set_led_state(color: str) -> Any:
+	device_id = _request_device()
+	if device_id is None:
+		return jsonify({"error": "Invalid device id"}), 400
 	color_key = color.lower()
-	if color_key not in TOPIC_LEDS:
+	if color_key not in LED_COLORS:
 		return jsonify({"error": "Unknown LED color"}), 404
 
 	data = request.get_json(silent=True) or {}
@@ -338,25 +651,56 @@ def set_led_state(color: str) -> Any:
 
 	_ensure_mqtt_running()
 
-	with state_lock:
-		led_states[color_key] = state
-		led_snapshot = dict(led_states)
+	with store.device(device_id) as device:
+		if device is None:
+			return jsonify({"error": "Too many devices"}), 503
+		device.leds[color_key] = state
+		device.commanded = True
+		led_snapshot = dict(device.leds)
+
+	_publish_led_states(device_id, led_snapshot)
+	return jsonify({"device": device_id, "color": color_key, "state": state, "leds": led_snapshot})
+
+
+@app.route("/api/leds", methods=["POST"])
+def set_led_scene() -> Any:
+	"""Sets any number of LEDs, e.g. {"red": "ON", "blue": "OFF"}, in one publish."""
+
+	device_id = _request_device()
+	if device_id is None:
+		return jsonify({"error": "Invalid device id"}), 400
+	data = request.get_json(silent=True)
+	if not isinstance(data, dict) or not data:
+		return jsonify({"error": "Expected an object mapping LED colors to states"}), 400
+
+	updates: Dict[str, str] = {}
+	for color_raw, state_raw in data.items():
+		color_key = str(color_raw).lower()
+		if color_key not in LED_COLORS:
+			return jsonify({"error": f"Unknown LED color '{color_raw}'"}), 404
+		state = str(state_raw).strip().upper()
+		if state not in VALID_LED_STATES:
+			return jsonify({"error": "State must be 'ON' or 'OFF'"}), 400
+		updates[color_key] = state
 
-	topic = TOPIC_LEDS[color_key]
-	if mqtt_client is None:
-		logger.warning("LED update requested before MQTT client ready")
-	else:
-		payload = json.dumps({"state": state})
-		try:
-			mqtt_client.publish(topic, payload=payload, qos=1, retain=True)
-		except Exception as exc:  # pylint: disable=broad-except
-			logger.exception("Failed to publish LED state for %s: %s", color_key, exc)
+	_ensure_mqtt_running()
+
+	with store.device(device_id) as device:
+		if device is None:
+			return jsonify({"error": "Too many devices"}), 503
+		device.leds.update(updates)
+		device.commanded = True
+		led_snapshot = dict(device.leds)
 
-	return jsonify({"color": color_key, "state": state, "leds": led_snapshot})
+	_publish_led_states(device_id, led_snapshot)
+	return jsonify({"device": device_id, "leds": led_snapshot})
 
 
 @app.route("/api/display", methods=["POST"])
 def send_display_message() -> Any:
+	device_id = _request_device()
+	if device_id is None:
+		return jsonify({"error": "Invalid device id"}), 400
 	data = request.get_json(silent=True) or {}
 	text_raw = data.get("text", "")
 	if not isinstance(text_raw, str):
@@ -369,35 +713,33 @@ def send_display_message() -> Any:
 
 	_ensure_mqtt_running()
 
-	with state_lock:
-		last_display_message.update({"text": text, "timestamp": time.time()})
-		display_snapshot = dict(last_display_message)
+	with store.device(device_id) as device:
+		if device is None:
+			return jsonify({"error": "Too many devices"}), 503
+		device.display.update({"text": text, "timestamp": time.time()})
+		device.commanded = True
+		display_snapshot = dict(device.display)
 
 	if mqtt_client is None:
 		logger.warning("Display update requested before MQTT client ready")
 	else:
 		payload = json.dumps({"text": text})
 		try:
-			mqtt_client.publish(TOPIC_DISPLAY, payload=payload, qos=1, retain=True)
+			mqtt_client.publish(_device_topic(device_id, SUFFIX_DISPLAY), payload=payload, qos=1, retain=True)
 		except Exception as exc:  # pylint: disable=broad-except
 			logger.exception("Failed to publish display text: %s", exc)
 
-	return jsonify({
-		"display": {
-			"text": display_snapshot.get("text", ""),
-			"timestamp": display_snapshot.get("timestamp"),
-			"timestamp_iso": _to_iso(display_snapshot.get("timestamp")),
-		},
-	})
+	return jsonify({"device": device_id, "display": _display_view(display_snapshot)})
 
 
 @app.route("/health")
 def health() -> Any:
-	with state_lock:
+	with connection_lock:
 		healthy = mqtt_started and (connection_state["connected"] or connection_state["last_error"] is None)
-	return jsonify({"status": "ok" if healthy else "degraded"})
+	return jsonify({"status": "ok" if healthy else "degraded", "devices": len(store), "streams": len(hub)})
 
 
 if __name__ == "__main__":
 	start_mqtt()
-	app.run(host="0.0.0.0", port=8000, debug=False)
+	# Each open dashboard stream holds a request thread
+	app.run(host="0.0.0.0", port=8000, debug=False, threaded=True)
@@ -0,0 +1,180 @@
+"""End-to-end LED command latency benchmark.
+
+Publishes sequence-numbered pings on the bench topic at one or more command
+rates and waits for the firmware (lab3_ex2 / lab3_ex3) to echo each one
+after it has driven the LED. Reports round-trip percentiles, throughput and
+loss per rate, plus the on-device receive-to-actuate time. lab3_ex3 polices
+pings like yellow LED commands (a burst of 8, then 10 per second), so loss
+above that rate is the rate limit at work.
+
+Usage:
+	python bench.py --rate 5 20 50 --count 200
+"""
+
+from __future__ import annotations
+
+import argparse
+import json
+import math
+import threading
+import time
+from typing import Any, Dict, List, Optional
+from uuid import uuid4
+
+import paho.mqtt.client as mqtt
+
+
+MQTT_BROKER = "mqtt.iotserver.uz"
+MQTT_PORT = 1883
+MQTT_USERNAME = "userTTPU"
+MQTT_PASSWORD = "mqttpass"
+TOPIC_PING = "ttpu/iot/maqsud/bench/ping"
+TOPIC_PONG = "ttpu/iot/maqsud/bench/pong"
+
+
+class PingTracker:
+	"""Matches pongs to the pings they answer."""
+
+	def __init__(self) -> None:
+		self.lock = threading.Lock()
+		self.sent: Dict[int, float] = {}
+		self.rtt_ms: List[float] = []
+		self.device_us: List[int] = []
+		self.last_reply = 0.0
+
+	def reset(self) -> None:
+		with self.lock:
+			self.sent.clear()
+			self.rtt_ms.clear()
+			self.device_us.clear()
+
+	def on_sent(self, seq: int) -> None:
+		with self.lock:
+			self.sent[seq] = time.perf_counter()
+
+	def on_pong(self, payload: Dict[str, Any]) -> None:
+		now = time.perf_counter()
+		seq = payload.get("seq")
+		with self.lock:
+			sent_at = self.sent.pop(seq, None)
+			if sent_at is None:
+				return  # late reply from an earlier run, or a duplicate
+			self.rtt_ms.append((now - sent_at) * 1000.0)
+			rx_us, act_us = payload.get("rx_us"), payload.get("act_us")
+			if isinstance(rx_us, int) and isinstance(act_us, int):
+				self.device_us.append(act_us - rx_us)
+			self.last_reply = now
+
+	def outstanding(self) -> int:
+		with self.lock:
+			return len(self.sent)
+
+
+def percentile(values: List[float], pct: float) -> Optional[float]:
+	"""Nearest-rank percentile; None for an empty list."""
+
+	if not values:
+		return None
+	ordered = sorted(values)
+	rank = max(1, math.ceil(pct / 100.0 * len(ordered)))
+	return ordered[min(rank, len(ordered)) - 1]
+
+
+def _fmt(value: Optional[float], unit: str) -> str:
+	return "--" if value is None else f"{value:.1f}{unit}"
+
+
+def run_rate(client: mqtt.Client, tracker: PingTracker, rate: float, count: int,
+		first_seq: int, qos: int, timeout: float) -> Dict[str, Any]:
+	tracker.reset()
+	interval = 1.0 / rate
+	start = time.perf_counter()
+	for i in range(count):
+		# Schedule against the start time so publish jitter does not accumulate
+		delay = start + i * interval - time.perf_counter()
+		if delay > 0:
+			time.sleep(delay)
+		seq = first_seq + i
+		state = "ON" if i % 2 == 0 else "OFF"
+		tracker.on_sent(seq)
+		client.publish(TOPIC_PING, json.dumps({"seq": seq, "state": state}), qos=qos)
+
+	deadline = time.perf_counter() + timeout
+	while tracker.outstanding() and time.perf_counter() < deadline:
+		time.sleep(0.01)
+
+	with tracker.lock:
+		rtt = list(tracker.rtt_ms)
+		device = [us / 1000.0 for us in tracker.device_us]
+		elapsed = (tracker.last_reply if rtt else time.perf_counter()) - start
+
+	return {
+		"rate": rate,
+		"sent": count,
+		"received": len(rtt),
+		"loss_pct": 100.0 * (count - len(rtt)) / count,
+		"throughput": len(rtt) / elapsed if elapsed > 0 else 0.0,
+		"p50": percentile(rtt, 50),
+		"p99": percentile(rtt, 99),
+		"max": max(rtt) if rtt else None,
+		"device_p50": percentile(device, 50),
+		"device_p99": percentile(device, 99),
+	}
+
+
+def main() -> None:
+	parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+	parser.add_argument("--rate", type=float, nargs="+", default=[10.0],
+		help="command rates to test, pings per second (default: 10)")
+	parser.add_argument("--count", type=int, default=100, help="pings per rate (default: 100)")
+	parser.add_argument("--qos", type=int, choices=(0, 1), default=0, help="ping QoS (default: 0)")
+	parser.add_argument("--timeout", type=float, default=3.0,
+		help="seconds to wait for outstanding pongs after the last ping (default: 3)")
+	parser.add_argument("--broker", default=MQTT_BROKER)
+	parser.add_argument("--port", type=int, default=MQTT_PORT)
+	args = parser.parse_args()
+
+	tracker = PingTracker()
+	connected = threading.Event()
+
+	def on_connect(client: mqtt.Client, _userdata: Any, _flags: Dict[str, Any], rc: int) -> None:
+		if rc == 0:
+			client.subscribe(TOPIC_PONG, qos=args.qos)
+			connected.set()
+
+	def on_message(_client: mqtt.Client, _userdata: Any, msg: mqtt.MQTTMessage) -> None:
+		try:
+			payload = json.loads(msg.payload)
+		except ValueError:
+			return
+		if isinstance(payload, dict):
+			tracker.on_pong(payload)
+
+	client = mqtt.Client(client_id=f"lab3-bench-{uuid4().hex[:8]}")
+	client.username_pw_set(MQTT_USERNAME, MQTT_PASSWORD)
+	client.on_connect = on_connect
+	client.on_message = on_message
+	client.connect(args.broker, args.port, keepalive=60)
+	client.loop_start()
+	if not connected.wait(10):
+		raise SystemExit(f"Could not connect to {args.broker}:{args.port}")
+	time.sleep(0.5)  # let the SUBACK arrive before the first ping
+
+	print(f"{'rate/s':>7} {'sent':>5} {'recv':>5} {'loss':>6} {'thru/s':>7} "
+		f"{'p50':>9} {'p99':>9} {'max':>9} {'dev p50':>9} {'dev p99':>9}")
+	seq = 1
+	try:
+		for rate in args.rate:
+			result = run_rate(client, tracker, rate, args.count, seq, args.qos, args.timeout)
+			seq += args.count
+			print(f"{result['rate']:>7.1f} {result['sent']:>5} {result['received']:>5} "
+				f"{result['loss_pct']:>5.1f}% {result['throughput']:>7.1f} "
+				f"{_fmt(result['p50'], 'ms'):>9} {_fmt(result['p99'], 'ms'):>9} {_fmt(result['max'], 'ms'):>9} "
+				f"{_fmt(result['device_p50'], 'ms'):>9} {_fmt(result['device_p99'], 'ms'):>9}")
+	finally:
+		client.loop_stop()
+		client.disconnect()
+
+
+if __name__ == "__main__":
+	main()
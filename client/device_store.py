@@ -0,0 +1,133 @@
+"""Per-device dashboard state, sharded so many nodes can be followed at once.
+
+Every device gets its own DeviceState. States live in a fixed number of
+shards, each behind its own lock, so the MQTT thread updating one node and
+HTTP requests reading another rarely wait on each other; a request only
+ever holds one shard lock, and only while it copies the data it returns.
+"""
+
+from __future__ import annotations
+
+import threading
+from array import array
+from collections import deque
+from contextlib import contextmanager
+from typing import Any, Callable, Dict, Iterator, List, Optional, Tuple
+
+
+class SeriesRing:
+	"""Fixed-capacity (timestamp, value) time series, oldest points overwritten.
+
+	Points closer together than resolution seconds are merged into the
+	newest one, so a node batching 50 readings a second costs one slot per
+	second. Storage is allocated once, as two flat arrays of doubles.
+	"""
+
+	def __init__(self, capacity: int, resolution: float = 1.0) -> None:
+		self.capacity = capacity
+		self.resolution = resolution
+		self._times = array("d", bytes(8 * capacity))
+		self._values = array("d", bytes(8 * capacity))
+		self._head = 0  # index of the oldest point
+		self._count = 0
+
+	def __len__(self) -> int:
+		return self._count
+
+	def append(self, timestamp: float, value: float) -> None:
+		if self._count:
+			last = (self._head + self._count - 1) % self.capacity
+			if 0 <= timestamp - self._times[last] < self.resolution:
+				self._values[last] = value
+				return
+		if self._count < self.capacity:
+			index = (self._head + self._count) % self.capacity
+			self._count += 1
+		else:
+			index = self._head
+			self._head = (self._head + 1) % self.capacity
+		self._times[index] = timestamp
+		self._values[index] = value
+
+	def query(self, since: float = 0.0, limit: Optional[int] = None) -> List[Tuple[float, float]]:
+		"""Points newer than since, oldest first, at most the newest limit of them."""
+
+		points: List[Tuple[float, float]] = []
+		for offset in range(self._count - 1, -1, -1):
+			index = (self._head + offset) % self.capacity
+			if self._times[index] <= since or (limit is not None and len(points) >= limit):
+				break
+			points.append((self._times[index], self._values[index]))
+		points.reverse()
+		return points
+
+
+class DeviceState:
+	"""Everything the dashboard knows about one node."""
+
+	def __init__(self, device_id: str, colors: List[str], history_points: int, event_history: int) -> None:
+		self.device_id = device_id
+		self.sensor: Dict[str, Optional[float]] = {
+			"light": None,
+			"min": None,
+			"max": None,
+			"ema": None,
+			"timestamp": None,
+		}
+		self.history = SeriesRing(history_points)
+		self.button_events: deque[Dict[str, Any]] = deque(maxlen=event_history)
+		self.leds: Dict[str, str] = {color: "OFF" for color in colors}
+		self.display: Dict[str, Any] = {"text": "", "timestamp": None}
+		self.metrics: Dict[str, Any] = {"data": None, "received_at": None}
+		self.last_message_at: Optional[float] = None
+		# Set once the dashboard has commanded this node, so its retained
+		# LED/display state is republished when the broker connection returns
+		self.commanded = False
+
+
+class _Shard:
+	__slots__ = ("lock", "devices")
+
+	def __init__(self) -> None:
+		self.lock = threading.Lock()
+		self.devices: Dict[str, DeviceState] = {}
+
+
+class DeviceStore:
+	"""DeviceStates keyed by device id, spread over independently locked shards."""
+
+	def __init__(self, factory: Callable[[str], DeviceState], shards: int = 16, max_devices: int = 1024) -> None:
+		self._factory = factory
+		self._shards = [_Shard() for _ in range(shards)]
+		self._max_devices = max_devices
+		self._count = 0
+		self._count_lock = threading.Lock()
+
+	def _shard(self, device_id: str) -> _Shard:
+		return self._shards[hash(device_id) % len(self._shards)]
+
+	@contextmanager
+	def device(self, device_id: str, create: bool = True) -> Iterator[Optional[DeviceState]]:
+		"""Holds the device's shard lock; yields None if it is unknown (or the store is full)."""
+
+		shard = self._shard(device_id)
+		with shard.lock:
+			state = shard.devices.get(device_id)
+			if state is None and create:
+				with self._count_lock:
+					if self._count < self._max_devices:
+						self._count += 1
+						state = shard.devices[device_id] = self._factory(device_id)
+			yield state
+
+	def __len__(self) -> int:
+		return self._count
+
+	def each(self, visit: Callable[[DeviceState], Any]) -> List[Any]:
+		"""Calls visit on every device, one shard lock at a time; returns the results."""
+
+		results: List[Any] = []
+		for shard in self._shards:
+			with shard.lock:
+				results.extend(visit(state) for state in shard.devices.values())
+		return results
@@ -0,0 +1,127 @@
+"""Server-sent-event fan-out of per-device state changes to dashboard browsers.
+
+The MQTT thread publishes one small delta per message it applies; the frame
+is serialized once and the same string is queued for every browser watching
+that device, so the cost of a message no longer grows with the size of the
+device state, only (cheaply) with the number of open pages.
+"""
+
+from __future__ import annotations
+
+import json
+import queue
+import threading
+from typing import Any, Dict, Iterator, List, Optional, Set
+
+
+def format_event(event: str, data: Any) -> str:
+	return f"event: {event}\ndata: {json.dumps(data, separators=(',', ':'))}\n\n"
+
+
+class Subscriber:
+	"""One open stream: a bounded queue of preformatted frames."""
+
+	def __init__(self, device_id: str, max_pending: int) -> None:
+		self.device_id = device_id
+		self.frames: queue.Queue[str] = queue.Queue(maxsize=max_pending)
+		# Set when frames had to be dropped because the browser fell behind;
+		# the stream then sends a full snapshot instead of the missing deltas
+		self.resync = threading.Event()
+
+	def offer(self, frame: str) -> None:
+		try:
+			self.frames.put_nowait(frame)
+		except queue.Full:
+			self.resync.set()
+
+	def next_frame(self, timeout: float) -> Optional[str]:
+		"""The next queued frame, or None after timeout seconds (or on resync)."""
+
+		if self.resync.is_set():
+			return None
+		try:
+			return self.frames.get(timeout=timeout)
+		except queue.Empty:
+			return None
+
+	def take_resync(self) -> bool:
+		if not self.resync.is_set():
+			return False
+		self.resync.clear()
+		while True:
+			try:
+				self.frames.get_nowait()
+			except queue.Empty:
+				return True
+
+
+class EventHub:
+	"""Subscribers grouped by device id."""
+
+	def __init__(self, max_pending: int = 64) -> None:
+		self._max_pending = max_pending
+		self._lock = threading.Lock()
+		self._subscribers: Dict[str, Set[Subscriber]] = {}
+
+	def subscribe(self, device_id: str) -> Subscriber:
+		subscriber = Subscriber(device_id, self._max_pending)
+		with self._lock:
+			self._subscribers.setdefault(device_id, set()).add(subscriber)
+		return subscriber
+
+	def unsubscribe(self, subscriber: Subscriber) -> None:
+		with self._lock:
+			watchers = self._subscribers.get(subscriber.device_id)
+			if watchers is not None:
+				watchers.discard(subscriber)
+				if not watchers:
+					del self._subscribers[subscriber.device_id]
+
+	def __len__(self) -> int:
+		with self._lock:
+			return sum(len(watchers) for watchers in self._subscribers.values())
+
+	def publish(self, device_id: str, event: str, data: Any) -> None:
+		"""Queues an event for the browsers watching device_id (cheap if none are)."""
+
+		with self._lock:
+			watchers: List[Subscriber] = list(self._subscribers.get(device_id, ()))
+		if watchers:
+			frame = format_event(event, data)
+			for subscriber in watchers:
+				subscriber.offer(frame)
+
+	def broadcast(self, event: str, data: Any) -> None:
+		"""Queues an event for every open stream."""
+
+		with self._lock:
+			watchers = [subscriber for group in self._subscribers.values() for subscriber in group]
+		if watchers:
+			frame = format_event(event, data)
+			for subscriber in watchers:
+				subscriber.offer(frame)
+
+
+def stream(hub: EventHub, device_id: str, snapshot: Any, keepalive: float = 15.0) -> Iterator[str]:
+	"""Generator for a text/event-stream response.
+
+	snapshot() returns the device's full state; it is sent first and again
+	whenever the subscriber's queue overflowed. A comment line is sent every
+	keepalive seconds of silence so proxies keep the connection open and a
+	closed browser is noticed.
+	"""
+
+	subscriber = hub.subscribe(device_id)
+	try:
+		# Subscribe before taking the snapshot so no change falls in between
+		yield format_event("state", snapshot())
+		while True:
+			frame = subscriber.next_frame(keepalive)
+			if frame is not None:
+				yield frame
+			elif subscriber.take_resync():
+				yield format_event("state", snapshot())
+			else:
+				yield ": keepalive\n\n"
+	finally:
+		hub.unsubscribe(subscriber)
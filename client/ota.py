@@ -0,0 +1,208 @@
+"""Firmware rollout to lab3_ex3 nodes over MQTT.
+
+Serves a firmware image over HTTP from this machine, sends each node a signed
+update command on ttpu/iot/<device>/ota and follows its progress on
+ttpu/iot/<device>/ota/status. Nodes are updated a wave at a time; the rollout
+stops at the first node that fails or rolls back, so a bad image reaches at
+most one wave. The key must match the NODE_OTA_KEY the nodes were built with,
+and --version the NODE_FIRMWARE_VERSION the image was built with: nodes refuse
+a version that is not above their own, so old commands cannot be replayed.
+
+Usage:
+	python ota.py .pio/build/lab3_ex3/firmware.bin --version 2 --key "$LAB3_OTA_KEY" --device sensor01 actuator01
+"""
+
+from __future__ import annotations
+
+import argparse
+import hashlib
+import hmac
+import http.server
+import json
+import os
+import socket
+import threading
+import time
+from typing import Any, Dict, List, Optional
+from uuid import uuid4
+
+import paho.mqtt.client as mqtt
+
+
+MQTT_BROKER = "mqtt.iotserver.uz"
+MQTT_PORT = 1883
+MQTT_USERNAME = "userTTPU"
+MQTT_PASSWORD = "mqttpass"
+TOPIC_ROOT = "ttpu/iot"
+DEFAULT_DEVICE = "maqsud"
+
+# Final states reported by the node (see lib/OtaUpdate/OtaUpdate.h)
+SUCCESS_STATES = {"confirmed"}
+FAILURE_STATES = {"failed", "rolled_back"}
+
+
+def sign(key: str, version: int, url: str, sha256: str) -> str:
+	return hmac.new(key.encode(), f"{version}\n{url}\n{sha256}".encode(), hashlib.sha256).hexdigest()
+
+
+def local_address(broker: str, port: int) -> str:
+	"""This machine's address on the route to the broker (the nodes' network)."""
+
+	with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as probe:
+		probe.connect((broker, port))
+		return probe.getsockname()[0]
+
+
+def serve_image(path: str, host: str, port: int) -> http.server.ThreadingHTTPServer:
+	"""Serves the image file (and nothing else) in a background thread."""
+
+	with open(path, "rb") as f:
+		image = f.read()
+
+	class ImageHandler(http.server.BaseHTTPRequestHandler):
+		def do_GET(self) -> None:
+			if self.path != "/firmware.bin":
+				self.send_error(404)
+				return
+			self.send_response(200)
+			self.send_header("Content-Type", "application/octet-stream")
+			self.send_header("Content-Length", str(len(image)))
+			self.end_headers()
+			self.wfile.write(image)
+
+		def log_message(self, fmt: str, *args: Any) -> None:
+			print(f"  http: {self.address_string()} {fmt % args}")
+
+	server = http.server.ThreadingHTTPServer((host, port), ImageHandler)
+	threading.Thread(target=server.serve_forever, daemon=True).start()
+	return server
+
+
+class RolloutTracker:
+	"""Latest live status per device."""
+
+	def __init__(self) -> None:
+		self.lock = threading.Lock()
+		self.changed = threading.Condition(self.lock)
+		self.status: Dict[str, Dict[str, Any]] = {}
+
+	def clear(self, device: str) -> None:
+		with self.lock:
+			self.status.pop(device, None)
+
+	def on_status(self, device: str, payload: Dict[str, Any]) -> None:
+		with self.lock:
+			self.status[device] = payload
+			self.changed.notify_all()
+
+	def wait(self, devices: List[str], timeout: float) -> Dict[str, Optional[str]]:
+		"""Final state per device once every one has finished (None on timeout)."""
+
+		deadline = time.monotonic() + timeout
+		reported: Dict[str, Any] = {}
+		with self.lock:
+			while True:
+				states = {device: self.status.get(device, {}).get("state") for device in devices}
+				for device, payload in self.status.items():
+					if device in devices and reported.get(device) != payload:
+						reported[device] = payload
+						error = f" ({payload['error']})" if payload.get("error") else ""
+						print(f"  {device}: {payload.get('state')} {payload.get('progress', 0)}% "
+							f"on {payload.get('partition', '?')} (v{payload.get('version', '?')}){error}")
+				if all(state in SUCCESS_STATES | FAILURE_STATES for state in states.values()):
+					return states
+				remaining = deadline - time.monotonic()
+				if remaining <= 0:
+					return {device: state if state in SUCCESS_STATES | FAILURE_STATES else None
+						for device, state in states.items()}
+				self.changed.wait(remaining)
+
+
+def main() -> None:
+	parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+	parser.add_argument("firmware", help="image to roll out, e.g. .pio/build/lab3_ex3/firmware.bin")
+	parser.add_argument("--version", type=int, required=True,
+		help="NODE_FIRMWARE_VERSION the image was built with; must be above the nodes' own")
+	parser.add_argument("--device", nargs="+", default=[DEFAULT_DEVICE],
+		help=f"device ids (NODE_ID) to update, in order (default: {DEFAULT_DEVICE})")
+	parser.add_argument("--key", default=os.environ.get("LAB3_OTA_KEY", ""),
+		help="signing key, as built into the nodes (default: $LAB3_OTA_KEY)")
+	parser.add_argument("--wave", type=int, default=1, help="nodes updated at once (default: 1)")
+	parser.add_argument("--timeout", type=float, default=300.0,
+		help="seconds a wave may take, download to confirmation (default: 300)")
+	parser.add_argument("--host", help="address the nodes download from (default: this machine's)")
+	parser.add_argument("--http-port", type=int, default=8070, help="image server port (default: 8070)")
+	parser.add_argument("--broker", default=MQTT_BROKER)
+	parser.add_argument("--port", type=int, default=MQTT_PORT)
+	args = parser.parse_args()
+	if not args.key:
+		raise SystemExit("No signing key: pass --key or set LAB3_OTA_KEY")
+	if not 0 < args.version <= 0xFFFFFFFF:
+		raise SystemExit("--version must be between 1 and 4294967295")
+
+	with open(args.firmware, "rb") as f:
+		sha256 = hashlib.sha256(f.read()).hexdigest()
+	host = args.host or local_address(args.broker, args.port)
+	url = f"http://{host}:{args.http_port}/firmware.bin"
+	command = json.dumps({"version": args.version, "url": url, "sha256": sha256,
+		"sig": sign(args.key, args.version, url, sha256)})
+	server = serve_image(args.firmware, "0.0.0.0", args.http_port)
+	print(f"Serving {args.firmware} ({os.path.getsize(args.firmware)} bytes, sha256 {sha256[:12]}...) at {url}")
+
+	tracker = RolloutTracker()
+	connected = threading.Event()
+
+	def on_connect(client: mqtt.Client, _userdata: Any, _flags: Dict[str, Any], rc: int) -> None:
+		if rc == 0:
+			client.subscribe(f"{TOPIC_ROOT}/+/ota/status", qos=1)
+			connected.set()
+
+	def on_message(_client: mqtt.Client, _userdata: Any, msg: mqtt.MQTTMessage) -> None:
+		# The retained status is from an earlier update; only follow this one
+		if msg.retain:
+			return
+		parts = msg.topic.split("/")
+		try:
+			payload = json.loads(msg.payload)
+		except ValueError:
+			return
+		if len(parts) == 5 and isinstance(payload, dict):
+			tracker.on_status(parts[2], payload)
+
+	client = mqtt.Client(client_id=f"lab3-ota-{uuid4().hex[:8]}")
+	client.username_pw_set(MQTT_USERNAME, MQTT_PASSWORD)
+	client.on_connect = on_connect
+	client.on_message = on_message
+	client.connect(args.broker, args.port, keepalive=60)
+	client.loop_start()
+	if not connected.wait(10):
+		raise SystemExit(f"Could not connect to {args.broker}:{args.port}")
+	time.sleep(0.5)  # let the SUBACK arrive before the first command
+
+	updated: List[str] = []
+	try:
+		for first in range(0, len(args.device), max(1, args.wave)):
+			wave = args.device[first:first + max(1, args.wave)]
+			print(f"Updating {', '.join(wave)}")
+			for device in wave:
+				tracker.clear(device)
+				client.publish(f"{TOPIC_ROOT}/{device}/ota", command, qos=1)
+			results = tracker.wait(wave, args.timeout)
+			failed = [device for device, state in results.items() if state not in SUCCESS_STATES]
+			updated += [device for device in wave if device not in failed]
+			if failed:
+				for device in failed:
+					print(f"  {device}: {results[device] or 'no answer'}")
+				remaining = args.device[first + len(wave):]
+				if remaining:
+					print(f"Rollout stopped; not updated: {', '.join(remaining)}")
+				raise SystemExit(1)
+		print(f"Rollout complete: {len(updated)} node(s) updated")
+	finally:
+		client.loop_stop()
+		client.disconnect()
+		server.shutdown()
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,41 @@
+#include "ButtonDebouncer.h"
+
+ButtonDebouncer::ButtonDebouncer(int64_t debounceUs, uint8_t initialLevel)
+  : debounceUs_(debounceUs),
+    stableLevel_(initialLevel),
+    pending_(false),
+    lastLevel_(initialLevel),
+    firstEdgeUs_(0),
+    lastEdgeUs_(0)
+{
+}
+
+void ButtonDebouncer::addEdge(uint8_t level, int64_t timeUs)
+{
+  if (!pending_) {
+    if (level == stableLevel_) {
+      return;
+    }
+    pending_ = true;
+    firstEdgeUs_ = timeUs;
+  }
+  lastLevel_ = level;
+  lastEdgeUs_ = timeUs;
+}
+
+bool ButtonDebouncer::poll(int64_t nowUs, ButtonEdge& edge)
+{
+  if (!pending_ || nowUs - lastEdgeUs_ < debounceUs_) {
+    return false;
+  }
+
+  pending_ = false;
+  if (lastLevel_ == stableLevel_) {
+    return false;  // glitch: settled back to the previous state
+  }
+
+  stableLevel_ = lastLevel_;
+  edge.level = stableLevel_;
+  edge.timeUs = firstEdgeUs_;
+  return true;
+}
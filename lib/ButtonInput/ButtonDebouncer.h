@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// One raw GPIO edge as captured by the button ISR
+struct ButtonEdge {
+  uint8_t level;
+  int64_t timeUs;
+};
+
+/**
+ * Software debouncer for timestamped button edges.
+ *
+ * Edges are fed in order with addEdge(). A new state is reported by poll()
+ * once the input has been quiet for the debounce window, stamped with the
+ * time of the first edge of that transition, so bounce does not skew the
+ * event time. A burst that settles back to the old state is discarded.
+ */
+class ButtonDebouncer {
+public:
+  ButtonDebouncer(int64_t debounceUs, uint8_t initialLevel);
+
+  void addEdge(uint8_t level, int64_t timeUs);
+
+  // Returns true and fills edge when a debounced state change is ready
+  bool poll(int64_t nowUs, ButtonEdge& edge);
+
+  uint8_t level() const { return stableLevel_; }
+
+private:
+  int64_t debounceUs_;
+  uint8_t stableLevel_;
+  bool pending_;
+  uint8_t lastLevel_;
+  int64_t firstEdgeUs_;
+  int64_t lastEdgeUs_;
+};
@@ -0,0 +1,121 @@
+#include "CalendarTime.h"
+
+namespace {
+// Beyond this gap update() recomputes the date instead of ticking
+const unsigned long MAX_TICK_GAP_MS = 3600000UL;
+}
+
+bool isLeapYear(int year)
+{
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int daysInMonth(int year, int month)
+{
+  static const uint8_t DAYS[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+  return month == 2 && isLeapYear(year) ? 29 : DAYS[month - 1];
+}
+
+// Day counting after Howard Hinnant's days_from_civil / civil_from_days,
+// with years starting in March so the leap day comes last
+int64_t calendarToEpoch(const CalendarTime& t)
+{
+  int64_t y = t.year - (t.month <= 2 ? 1 : 0);
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (t.month + (t.month > 2 ? -3 : 9)) + 2) / 5 + t.day - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int64_t days = era * 146097 + doe - 719468;
+  return days * 86400 + t.hour * 3600 + t.minute * 60 + t.second;
+}
+
+CalendarTime calendarFromEpoch(int64_t epochSeconds)
+{
+  int64_t days = epochSeconds / 86400;
+  int64_t secs = epochSeconds % 86400;
+  if (secs < 0) {
+    secs += 86400;
+    days--;
+  }
+
+  CalendarTime t;
+  t.hour = secs / 3600;
+  t.minute = secs / 60 % 60;
+  t.second = secs % 60;
+
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t doe = days - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  t.day = doy - (153 * mp + 2) / 5 + 1;
+  t.month = mp < 10 ? mp + 3 : mp - 9;
+  t.year = yoe + era * 400 + (t.month <= 2 ? 1 : 0);
+  return t;
+}
+
+void calendarTick(CalendarTime& t)
+{
+  if (++t.second < 60) {
+    return;
+  }
+  t.second = 0;
+  if (++t.minute < 60) {
+    return;
+  }
+  t.minute = 0;
+  if (++t.hour < 24) {
+    return;
+  }
+  t.hour = 0;
+  if (++t.day <= daysInMonth(t.year, t.month)) {
+    return;
+  }
+  t.day = 1;
+  if (++t.month <= 12) {
+    return;
+  }
+  t.month = 1;
+  t.year++;
+}
+
+CalendarClock::CalendarClock(const CalendarTime& start, long utcOffsetSeconds, unsigned long nowMs)
+  : utcOffset_(utcOffsetSeconds),
+    synced_(false)
+{
+  rebase((calendarToEpoch(start) - utcOffsetSeconds) * 1000, nowMs);
+}
+
+void CalendarClock::sync(int64_t epochMs, unsigned long nowMs)
+{
+  rebase(epochMs, nowMs);
+  synced_ = true;
+}
+
+const CalendarTime& CalendarClock::update(unsigned long nowMs)
+{
+  unsigned long elapsed = nowMs - baseMs_;
+  if (elapsed >= MAX_TICK_GAP_MS) {
+    rebase(epochMs(nowMs), nowMs);
+    return local_;
+  }
+  while (elapsed >= 1000) {
+    elapsed -= 1000;
+    baseMs_ += 1000;
+    baseEpochMs_ += 1000;
+    calendarTick(local_);
+  }
+  return local_;
+}
+
+void CalendarClock::rebase(int64_t epochMs, unsigned long nowMs)
+{
+  int64_t fraction = epochMs % 1000;
+  if (fraction < 0) {
+    fraction += 1000;
+  }
+  baseEpochMs_ = epochMs - fraction;
+  baseMs_ = nowMs - (unsigned long)fraction;
+  local_ = calendarFromEpoch(baseEpochMs_ / 1000 + utcOffset_);
+}
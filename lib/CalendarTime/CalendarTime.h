@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Gregorian date/time (proleptic, no leap seconds) and an incrementally
+ * advancing clock built on it. Portable, so it can be exercised in the
+ * native build.
+ */
+struct CalendarTime {
+  int year;
+  int month;   // 1..12
+  int day;     // 1..28/29/30/31
+  int hour;
+  int minute;
+  int second;
+};
+
+bool isLeapYear(int year);
+int daysInMonth(int year, int month);
+
+// Seconds since 1970-01-01 00:00:00 for t (taken as UTC), and back
+int64_t calendarToEpoch(const CalendarTime& t);
+CalendarTime calendarFromEpoch(int64_t epochSeconds);
+
+// Advances t by one second, carrying into minutes, days, months and years
+void calendarTick(CalendarTime& t);
+
+/**
+ * Wall clock on top of a monotonic millisecond counter (millis()).
+ *
+ * Until sync() is called the clock runs from a fixed start time at boot, so
+ * it also works without a network. update() advances the displayed
+ * date one second at a time (no divisions on the hot path) and never
+ * drifts from the millisecond counter, however irregular the calls are.
+ * epochMs() gives the same time base for telemetry timestamps.
+ *
+ * Call update() at least every few weeks so the base stays well inside
+ * the range of the 32-bit counter.
+ */
+class CalendarClock {
+public:
+  // start is local time at nowMs; utcOffsetSeconds is local minus UTC
+  CalendarClock(const CalendarTime& start, long utcOffsetSeconds, unsigned long nowMs = 0);
+
+  // Sets the clock from a UTC time (ms since the epoch) valid at nowMs
+  void sync(int64_t epochMs, unsigned long nowMs);
+
+  // Local date/time at nowMs
+  const CalendarTime& update(unsigned long nowMs);
+
+  // UTC ms since the epoch at nowMs (which may also lie in the past)
+  int64_t epochMs(unsigned long nowMs) const { return baseEpochMs_ + (long)(nowMs - baseMs_); }
+
+  bool synced() const { return synced_; }
+
+private:
+  void rebase(int64_t epochMs, unsigned long nowMs);
+
+  long utcOffset_;
+  int64_t baseEpochMs_;  // whole UTC second shown by local_
+  unsigned long baseMs_; // counter value at which that second began
+  CalendarTime local_;
+  bool synced_;
+};
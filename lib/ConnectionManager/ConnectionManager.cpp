@@ -0,0 +1,290 @@
+#include "ConnectionManager.h"
+
+#include <Preferences.h>
+#include <string.h>
+#include "Log.h"
+
+namespace {
+const uint32_t CACHE_MAGIC = 0x57464331;  // "WFC1"
+const char* CACHE_NAMESPACE = "wifi";
+const char* CACHE_KEY = "cache";
+
+// FNV-1a
+uint32_t ssidHash(const char* ssid)
+{
+  uint32_t hash = 2166136261u;
+  while (*ssid) {
+    hash = (hash ^ (uint8_t)*ssid++) * 16777619u;
+  }
+  return hash;
+}
+}
+
+RTC_DATA_ATTR ConnectionManager::WiFiCache ConnectionManager::rtcCache_;
+
+ConnectionManager::ConnectionManager(WiFiClient& net, PubSubClient& mqtt)
+  : net_(net),
+    mqtt_(mqtt),
+    session_(net),
+    cleanSession_(false),
+    onConnected_(nullptr),
+    ssid_(nullptr),
+    password_(nullptr),
+    mqttUsername_(nullptr),
+    mqttPassword_(nullptr),
+    state_(WIFI_DOWN),
+    stateSince_(0),
+    attemptSince_(0),
+    retryAt_(0),
+    wifiBackoff_(0),
+    mqttBackoff_(0),
+    connects_(0),
+    fastPath_(false),
+    staticIp_(false),
+    verifyLease_(false),
+    wifiConnectMs_(0)
+{
+  clientId_[0] = '\0';
+  memset(&cache_, 0, sizeof(cache_));
+}
+
+void ConnectionManager::begin(const char* ssid, const char* password,
+                              const char* mqttUsername, const char* mqttPassword)
+{
+  ssid_ = ssid;
+  password_ = password;
+  mqttUsername_ = mqttUsername;
+  mqttPassword_ = mqttPassword;
+
+  WiFi.mode(WIFI_STA);
+  // Route the MQTT traffic through session_ to learn the CONNACK flags
+  mqtt_.setClient(session_);
+  snprintf(clientId_, sizeof(clientId_), "esp32-client-%s", WiFi.macAddress().c_str());
+
+  // Keep the unavoidable blocking inside PubSubClient::connect() short:
+  // TCP connect and CONNACK wait are both bounded to a couple of seconds.
+  net_.setTimeout(2);
+  mqtt_.setSocketTimeout(2);
+
+  randomSeed(esp_random());
+
+  // Cached association: RTC memory after deep sleep, NVS after power loss
+  if (rtcCache_.magic == CACHE_MAGIC) {
+    cache_ = rtcCache_;
+  }
+  else {
+    Preferences prefs;
+    if (prefs.begin(CACHE_NAMESPACE, true)) {
+      if (prefs.getBytes(CACHE_KEY, &cache_, sizeof(cache_)) != sizeof(cache_)) {
+        cache_.magic = 0;
+      }
+      prefs.end();
+    }
+  }
+  if (cache_.magic != CACHE_MAGIC || cache_.ssidHash != ssidHash(ssid)) {
+    cache_.magic = 0;
+  }
+
+  unsigned long now = millis();
+  state_ = WIFI_DOWN;
+  stateSince_ = now;
+  retryAt_ = now;
+}
+
+void ConnectionManager::setOnConnected(ConnectedCallback callback)
+{
+  onConnected_ = callback;
+}
+
+void ConnectionManager::loop()
+{
+  unsigned long now = millis();
+  bool wifiUp = WiFi.status() == WL_CONNECTED;
+
+  switch (state_) {
+    case WIFI_DOWN:
+      if ((long)(now - retryAt_) >= 0) {
+        attemptSince_ = now;
+        startWiFi(now);
+      }
+      break;
+
+    case WIFI_CONNECTING:
+      if (wifiUp) {
+        onWiFiConnected(now);
+      }
+      else if (fastPath_ && now - stateSince_ >= FAST_CONNECT_TIMEOUT_MS) {
+        LOG_WARN("Cached AP did not answer, doing a full WiFi connect");
+        WiFi.disconnect();
+        dropCache();
+        startWiFi(now);
+      }
+      else if (now - stateSince_ >= WIFI_CONNECT_TIMEOUT_MS) {
+        LOG_WARN("WiFi connection timed out");
+        WiFi.disconnect();
+        enterWiFiDown(now);
+      }
+      break;
+
+    case MQTT_DOWN:
+      if (!wifiUp) {
+        LOG_WARN("WiFi disconnected! Reconnecting...");
+        enterWiFiDown(now);
+      }
+      else if ((long)(now - retryAt_) >= 0) {
+        tryMqttConnect();
+      }
+      break;
+
+    case MQTT_CONNECTED:
+      if (!wifiUp) {
+        LOG_WARN("WiFi disconnected! Reconnecting...");
+        mqtt_.disconnect();
+        enterWiFiDown(now);
+      }
+      else if (!mqtt_.loop()) {
+        LOG_WARN("MQTT disconnected! Reconnecting...");
+        enterMqttDown(now);
+      }
+      break;
+  }
+}
+
+void ConnectionManager::startWiFi(unsigned long now)
+{
+  fastPath_ = cache_.magic == CACHE_MAGIC;
+  bool useLease = fastPath_ && cache_.ip != 0 && cache_.staticConnects < DHCP_REFRESH_CONNECTS;
+  if (useLease) {
+    WiFi.config(IPAddress(cache_.ip), IPAddress(cache_.gateway), IPAddress(cache_.subnet), IPAddress(cache_.dns));
+    staticIp_ = true;
+  }
+  else if (staticIp_) {
+    // Back to DHCP
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+    staticIp_ = false;
+  }
+
+  if (fastPath_) {
+    LOG_INFO("Connecting to WiFi (cached AP on channel %u%s)...", cache_.channel, useLease ? ", cached IP" : "");
+    WiFi.begin(ssid_, password_, cache_.channel, cache_.bssid);
+  }
+  else {
+    LOG_INFO("Connecting to WiFi...");
+    WiFi.begin(ssid_, password_);
+  }
+  state_ = WIFI_CONNECTING;
+  stateSince_ = now;
+}
+
+void ConnectionManager::onWiFiConnected(unsigned long now)
+{
+  wifiConnectMs_ = now - attemptSince_;
+  LOG_INFO("WiFi connected in %lu ms%s! IP address: %s", wifiConnectMs_, fastPath_ ? " (cached)" : "",
+           WiFi.localIP().toString().c_str());
+  wifiBackoff_ = 0;
+  verifyLease_ = staticIp_;
+  state_ = MQTT_DOWN;
+  stateSince_ = now;
+  retryAt_ = now;
+
+  WiFiCache fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid == nullptr) {
+    return;
+  }
+  fresh.magic = CACHE_MAGIC;
+  fresh.ssidHash = ssidHash(ssid_);
+  memcpy(fresh.bssid, bssid, sizeof(fresh.bssid));
+  fresh.channel = WiFi.channel();
+  fresh.staticConnects = staticIp_ ? cache_.staticConnects + 1 : 0;
+  fresh.ip = WiFi.localIP();
+  fresh.gateway = WiFi.gatewayIP();
+  fresh.subnet = WiFi.subnetMask();
+  fresh.dns = WiFi.dnsIP(0);
+
+  // Write NVS only when the network changed, not for the counter alone
+  WiFiCache previous = cache_;
+  previous.staticConnects = fresh.staticConnects;
+  bool changed = memcmp(&previous, &fresh, sizeof(fresh)) != 0;
+  cache_ = fresh;
+  rtcCache_ = fresh;
+  if (changed) {
+    Preferences prefs;
+    if (prefs.begin(CACHE_NAMESPACE, false)) {
+      prefs.putBytes(CACHE_KEY, &fresh, sizeof(fresh));
+      prefs.end();
+    }
+  }
+}
+
+void ConnectionManager::dropCache()
+{
+  cache_.magic = 0;
+  rtcCache_.magic = 0;
+  Preferences prefs;
+  if (prefs.begin(CACHE_NAMESPACE, false)) {
+    prefs.remove(CACHE_KEY);
+    prefs.end();
+  }
+}
+
+void ConnectionManager::enterWiFiDown(unsigned long now)
+{
+  state_ = WIFI_DOWN;
+  stateSince_ = now;
+  retryAt_ = now + nextBackoff(wifiBackoff_);
+}
+
+void ConnectionManager::enterMqttDown(unsigned long now)
+{
+  state_ = MQTT_DOWN;
+  stateSince_ = now;
+  retryAt_ = now + nextBackoff(mqttBackoff_);
+}
+
+void ConnectionManager::tryMqttConnect()
+{
+  LOG_INFO("Connecting to MQTT broker...");
+
+  if (mqtt_.connect(clientId_, mqttUsername_, mqttPassword_, nullptr, 0, false, nullptr, cleanSession_)) {
+    bool resumed = !cleanSession_ && connects_ > 0 && session_.sessionPresent();
+    LOG_INFO("Connected to MQTT broker! (%s session)", resumed ? "resumed" : "new");
+    mqttBackoff_ = 0;
+    verifyLease_ = false;
+    connects_++;
+    state_ = MQTT_CONNECTED;
+    stateSince_ = millis();
+    if (onConnected_) {
+      onConnected_(mqtt_, resumed);
+    }
+  }
+  else if (verifyLease_) {
+    // The cached lease may be stale (address taken, other subnet): redo
+    // the WiFi connect with a scan and DHCP rather than retrying on it
+    LOG_WARN("MQTT connection failed, rc=%d, on the cached IP; doing a full WiFi connect", mqtt_.state());
+    verifyLease_ = false;
+    WiFi.disconnect();
+    dropCache();
+    startWiFi(millis());
+  }
+  else {
+    enterMqttDown(millis());
+    LOG_WARN("MQTT connection failed, rc=%d, retrying in %lu ms", mqtt_.state(), retryAt_ - millis());
+  }
+}
+
+// Exponential backoff with "equal jitter": the wait doubles on every
+// consecutive failure and the actual delay is drawn from [wait/2, wait],
+// so a fleet of nodes does not hammer the broker in lockstep.
+unsigned long ConnectionManager::nextBackoff(unsigned long& backoff)
+{
+  if (backoff == 0) {
+    backoff = BACKOFF_MIN_MS;
+  }
+  else {
+    backoff = backoff * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : backoff * 2;
+  }
+  unsigned long half = backoff / 2;
+  return half + random(half + 1);
+}
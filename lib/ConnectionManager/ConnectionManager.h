@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "SessionClient.h"
+
+/**
+ * Non-blocking WiFi + MQTT connection manager.
+ *
+ * Call loop() from every Arduino loop(). It never waits on the network:
+ * each call advances the connection state machine by at most one step,
+ * retries are scheduled with millis() using exponential backoff with jitter,
+ * and mqtt.loop() is serviced while the session is up.
+ *
+ * By default the MQTT session is persistent (clean session off, with a
+ * client id fixed per device): the broker keeps our subscriptions and
+ * queues QoS 1 messages while we are offline, so a reconnect does not have
+ * to subscribe again and does not lose commands sent in the meantime.
+ *
+ * Fast reconnect: after each successful association the AP's BSSID and
+ * channel and the DHCP lease (IP, gateway, subnet, DNS) are cached in RTC
+ * memory (survives deep sleep) and NVS (survives power loss). The next
+ * connect, after a reboot or a drop, goes straight to that AP without a
+ * scan and reuses the address without DHCP. A fresh DHCP lease is taken
+ * every DHCP_REFRESH_CONNECTS connects so the router still sees the
+ * address in use. If the fast attempt does not associate within
+ * FAST_CONNECT_TIMEOUT_MS, or the broker is unreachable right after it,
+ * the cache is dropped and a full scan-and-DHCP connect follows at once.
+ */
+class ConnectionManager {
+public:
+  enum State {
+    WIFI_DOWN,        // waiting for the next WiFi attempt
+    WIFI_CONNECTING,  // WiFi.begin() issued, waiting for association
+    MQTT_DOWN,        // WiFi up, waiting for the next MQTT attempt
+    MQTT_CONNECTED    // session up, messages are being processed
+  };
+
+  // Called once each time the MQTT session comes up. sessionResumed is true
+  // when the broker kept the session of the previous connection in this
+  // boot, so subscriptions are still in place; it is always false on the
+  // first connection after boot, so subscribing then fetches retained state.
+  typedef void (*ConnectedCallback)(PubSubClient& mqtt, bool sessionResumed);
+
+  ConnectionManager(WiFiClient& net, PubSubClient& mqtt);
+
+  void begin(const char* ssid, const char* password,
+             const char* mqttUsername, const char* mqttPassword);
+  void setOnConnected(ConnectedCallback callback);
+  void setCleanSession(bool clean) { cleanSession_ = clean; }
+  void loop();
+
+  bool connected() const { return state_ == MQTT_CONNECTED; }
+  State state() const { return state_; }
+
+  // MQTT sessions established after the first one
+  uint32_t reconnects() const { return connects_ > 0 ? connects_ - 1 : 0; }
+
+  // Time from the start of the last connect attempt to an IP address
+  // (including a cached attempt that fell back to a full connect)
+  unsigned long wifiConnectMs() const { return wifiConnectMs_; }
+
+  // Backoff tuning (milliseconds)
+  static const unsigned long BACKOFF_MIN_MS = 500;
+  static const unsigned long BACKOFF_MAX_MS = 30000;
+  static const unsigned long WIFI_CONNECT_TIMEOUT_MS = 10000;
+  static const unsigned long FAST_CONNECT_TIMEOUT_MS = 3000;
+  static const uint8_t DHCP_REFRESH_CONNECTS = 50;
+
+private:
+  // Last successful association, see "Fast reconnect" above
+  struct WiFiCache {
+    uint32_t magic;        // CACHE_MAGIC when valid
+    uint32_t ssidHash;     // the cache belongs to this network only
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t staticConnects;  // connects on the cached lease since DHCP
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+  };
+
+  static WiFiCache rtcCache_;  // RTC memory copy of cache_
+
+  void startWiFi(unsigned long now);
+  void onWiFiConnected(unsigned long now);
+  void dropCache();
+  void enterWiFiDown(unsigned long now);
+  void enterMqttDown(unsigned long now);
+  void tryMqttConnect();
+  unsigned long nextBackoff(unsigned long& backoff);
+
+  WiFiClient& net_;
+  PubSubClient& mqtt_;
+  SessionClient session_;
+  bool cleanSession_;
+  ConnectedCallback onConnected_;
+
+  const char* ssid_;
+  const char* password_;
+  const char* mqttUsername_;
+  const char* mqttPassword_;
+  char clientId_[40];
+
+  State state_;
+  unsigned long stateSince_;
+  unsigned long attemptSince_;  // first WiFi.begin() of the current attempt
+  unsigned long retryAt_;
+  unsigned long wifiBackoff_;
+  unsigned long mqttBackoff_;
+  uint32_t connects_;
+
+  WiFiCache cache_;
+  bool fastPath_;      // the current/last WiFi attempt used cache_
+  bool staticIp_;      // WiFi.config() is set to the cached lease
+  bool verifyLease_;   // drop cache_ if the first MQTT attempt on it fails
+  unsigned long wifiConnectMs_;
+};
@@ -0,0 +1,103 @@
+#include "SessionClient.h"
+
+// CONNACK: 0x20, remaining length 2, acknowledge flags, return code
+static const uint8_t CONNACK_HEADER = 0x20;
+static const uint8_t CONNACK_SIZE = 4;
+
+SessionClient::SessionClient(WiFiClient& net)
+  : net_(net),
+    connackPos_(CONNACK_SIZE),
+    sessionPresent_(false)
+{
+}
+
+int SessionClient::connect(IPAddress ip, uint16_t port)
+{
+  startSniffing();
+  return net_.connect(ip, port);
+}
+
+int SessionClient::connect(const char* host, uint16_t port)
+{
+  startSniffing();
+  return net_.connect(host, port);
+}
+
+size_t SessionClient::write(uint8_t b)
+{
+  return net_.write(b);
+}
+
+size_t SessionClient::write(const uint8_t* buf, size_t size)
+{
+  return net_.write(buf, size);
+}
+
+int SessionClient::available()
+{
+  return net_.available();
+}
+
+int SessionClient::read()
+{
+  int b = net_.read();
+  if (b >= 0) {
+    sniff((uint8_t)b);
+  }
+  return b;
+}
+
+int SessionClient::read(uint8_t* buf, size_t size)
+{
+  int n = net_.read(buf, size);
+  for (int i = 0; i < n && connackPos_ < CONNACK_SIZE; i++) {
+    sniff(buf[i]);
+  }
+  return n;
+}
+
+int SessionClient::peek()
+{
+  return net_.peek();
+}
+
+void SessionClient::flush()
+{
+  net_.flush();
+}
+
+void SessionClient::stop()
+{
+  net_.stop();
+}
+
+uint8_t SessionClient::connected()
+{
+  return net_.connected();
+}
+
+SessionClient::operator bool()
+{
+  return (bool)net_;
+}
+
+void SessionClient::startSniffing()
+{
+  connackPos_ = 0;
+  sessionPresent_ = false;
+}
+
+void SessionClient::sniff(uint8_t b)
+{
+  if (connackPos_ >= CONNACK_SIZE) {
+    return;
+  }
+  if (connackPos_ == 0 && b != CONNACK_HEADER) {
+    connackPos_ = CONNACK_SIZE;  // not a CONNACK: leave the flag cleared
+    return;
+  }
+  if (connackPos_ == 2) {
+    sessionPresent_ = (b & 0x01) != 0;
+  }
+  connackPos_++;
+}
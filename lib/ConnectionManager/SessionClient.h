@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+/**
+ * Pass-through Client that reports the MQTT CONNACK "session present" flag.
+ *
+ * PubSubClient reads the CONNACK itself and does not expose its flags, so
+ * this wrapper sits between PubSubClient and the WiFiClient and watches the
+ * first four bytes received after each TCP connect (the CONNACK is always
+ * the first packet from the broker).
+ */
+class SessionClient : public Client {
+public:
+  explicit SessionClient(WiFiClient& net);
+
+  // true if the broker resumed a stored session on the last connect
+  bool sessionPresent() const { return sessionPresent_; }
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void flush() override;
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override;
+
+private:
+  void startSniffing();
+  void sniff(uint8_t b);
+
+  WiFiClient& net_;
+  uint8_t connackPos_;  // CONNACK bytes seen, 4 when done
+  bool sessionPresent_;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Shadow framebuffer for character LCDs.
+ *
+ * Draw into the framebuffer with print()/printLine(), then flush() sends
+ * only the cells that differ from what the display already shows, one
+ * setCursor() + write() per run of changed cells. No lcd.clear() needed,
+ * so there is no flicker and unchanged text costs no bus traffic.
+ *
+ * Works with any display type that has setCursor(col, row) and
+ * write(const uint8_t*, size_t) (hd44780, LiquidCrystal_I2C, ...).
+ */
+template <uint8_t Cols = 16, uint8_t Rows = 2>
+class LcdFrameBuffer {
+public:
+  LcdFrameBuffer()
+  {
+    clear();
+    invalidate();
+  }
+
+  // Blank the whole framebuffer
+  void clear()
+  {
+    memset(pending_, ' ', sizeof(pending_));
+  }
+
+  // Forget what the display shows so the next flush() redraws every cell
+  // (call after lcd.clear() or a display re-init)
+  void invalidate()
+  {
+    memset(shown_, 0, sizeof(shown_));
+  }
+
+  // Write text at (col, row), clipped to the row
+  void print(uint8_t col, uint8_t row, const char* text)
+  {
+    if (row >= Rows) {
+      return;
+    }
+    for (; col < Cols && *text; col++, text++) {
+      pending_[row][col] = *text;
+    }
+  }
+
+  // Replace a whole row with formatted text, padded with spaces
+  void printLine(uint8_t row, const char* format, ...)
+  {
+    if (row >= Rows) {
+      return;
+    }
+    char line[Cols + 1];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    size_t len = strlen(line);
+    memcpy(pending_[row], line, len);
+    memset(pending_[row] + len, ' ', Cols - len);
+  }
+
+  // Sends changed cells to the display; returns how many were written
+  template <typename Lcd>
+  size_t flush(Lcd& lcd)
+  {
+    size_t written = 0;
+    for (uint8_t row = 0; row < Rows; row++) {
+      uint8_t col = 0;
+      while (col < Cols) {
+        if (pending_[row][col] == shown_[row][col]) {
+          col++;
+          continue;
+        }
+        uint8_t start = col;
+        while (col < Cols && pending_[row][col] != shown_[row][col]) {
+          col++;
+        }
+        lcd.setCursor(start, row);
+        lcd.write(reinterpret_cast<const uint8_t*>(&pending_[row][start]), col - start);
+        memcpy(&shown_[row][start], &pending_[row][start], col - start);
+        written += col - start;
+      }
+    }
+    return written;
+  }
+
+  const char* row(uint8_t r) const { return pending_[r]; }
+
+private:
+  char pending_[Rows][Cols];
+  char shown_[Rows][Cols];
+};
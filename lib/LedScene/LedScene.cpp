@@ -0,0 +1,86 @@
+#include "LedScene.h"
+
+#include "PayloadParser.h"
+
+bool parseLedScene(const uint8_t* payload, size_t length,
+                   const LedChannel* channels, size_t count, LedChange& out)
+{
+  LedChange change = { 0, 0 };
+  bool any = false;
+
+  FlatJsonReader reader(payload, length);
+  JsonToken key;
+  JsonToken value;
+  while (reader.next(key, value)) {
+    if (tokenEquals(key, "mask")) {
+      uint32_t mask;
+      if (!tokenToUint(value, mask) || (count < 32 && (mask >> count) != 0)) {
+        return false;
+      }
+      for (size_t i = 0; i < count; i++) {
+        uint32_t bit = 1UL << channels[i].pin;
+        if (mask & (1UL << i)) {
+          change.set |= bit;
+          change.clear &= ~bit;
+        }
+        else {
+          change.clear |= bit;
+          change.set &= ~bit;
+        }
+      }
+      any = true;
+      continue;
+    }
+
+    size_t i = 0;
+    while (i < count && !tokenEquals(key, channels[i].name)) {
+      i++;
+    }
+    if (i == count || !value.isString) {
+      return false;
+    }
+    uint32_t bit = 1UL << channels[i].pin;
+    if (tokenEquals(value, "ON")) {
+      change.set |= bit;
+      change.clear &= ~bit;
+    }
+    else if (tokenEquals(value, "OFF")) {
+      change.clear |= bit;
+      change.set &= ~bit;
+    }
+    else {
+      return false;
+    }
+    any = true;
+  }
+
+  if (reader.failed() || !any) {
+    return false;
+  }
+  out = change;
+  return true;
+}
+
+LedCoalescer::LedCoalescer()
+  : pending_{ 0, 0 },
+    coalesced_(0)
+{
+}
+
+void LedCoalescer::add(const LedChange& change)
+{
+  uint32_t overlap = (pending_.set | pending_.clear) & (change.set | change.clear);
+  coalesced_ += __builtin_popcount(overlap);
+  pending_.set = (pending_.set & ~change.clear) | change.set;
+  pending_.clear = (pending_.clear & ~change.set) | change.clear;
+}
+
+bool LedCoalescer::take(LedChange& out)
+{
+  if ((pending_.set | pending_.clear) == 0) {
+    return false;
+  }
+  out = pending_;
+  pending_ = { 0, 0 };
+  return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Combined LED command: one message sets several outputs at once.
+ *
+ * Accepted payloads (channel i is channels[i]):
+ *
+ *   {"mask":5}                  bit i set -> channel i ON, clear -> OFF
+ *   {"red":"ON","blue":"OFF"}   only the named channels change
+ *
+ * The result is a pair of GPIO bitmasks for the ESP32 W1TS/W1TC registers,
+ * so every channel switches within two register writes instead of one
+ * digitalWrite() per pin. Only GPIO 0-31 fit in the masks.
+ */
+struct LedChannel {
+  const char* name;
+  uint8_t pin;
+};
+
+struct LedChange {
+  uint32_t set;    // pins to drive HIGH
+  uint32_t clear;  // pins to drive LOW
+};
+
+// LedChange for a single pin
+inline LedChange ledChangeFor(uint8_t pin, bool on)
+{
+  uint32_t bit = 1UL << pin;
+  return on ? LedChange{ bit, 0 } : LedChange{ 0, bit };
+}
+
+// Parses a combined LED command into out. Returns false (out untouched) on
+// malformed JSON, an empty object, an unknown channel name, a state other
+// than "ON"/"OFF" or mask bits beyond count; nothing is half-applied.
+bool parseLedScene(const uint8_t* payload, size_t length,
+                   const LedChannel* channels, size_t count, LedChange& out);
+
+/**
+ * Merges LED changes so only the latest state per pin is applied: a pin
+ * that is already pending takes the newer state, and take() hands over the
+ * merged result in one piece.
+ */
+class LedCoalescer {
+public:
+  LedCoalescer();
+
+  void add(const LedChange& change);
+
+  // Moves the pending change to out; false if nothing is pending
+  bool take(LedChange& out);
+
+  // Pending pin states overwritten before they were applied
+  uint32_t coalesced() const { return coalesced_; }
+
+private:
+  LedChange pending_;
+  uint32_t coalesced_;
+};
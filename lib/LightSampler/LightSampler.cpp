@@ -0,0 +1,107 @@
+#include "LightSampler.h"
+
+LightSampler* LightSampler::instance_ = nullptr;
+
+bool LightSampler::begin(int pin, uint32_t sampleRateHz, size_t windowSize,
+                         uint8_t timerNum, uint8_t emaShift, BaseType_t core)
+{
+  if (instance_ != nullptr || sampleRateHz == 0 || windowSize == 0 || windowSize > MAX_WINDOW) {
+    return false;
+  }
+
+  pin_ = pin;
+  windowSize_ = windowSize;
+  emaShift_ = emaShift;
+  active_ = 0;
+  fill_ = 0;
+  ready_ = -1;
+  readyAt_ = 0;
+  overruns_ = 0;
+  emaScaled_ = 0;
+  emaValid_ = false;
+  instance_ = this;
+
+  pinMode(pin_, INPUT);
+
+  if (xTaskCreatePinnedToCore(taskEntry, "light_adc", 2048, this,
+                              configMAX_PRIORITIES - 2, &task_, core) != pdPASS) {
+    instance_ = nullptr;
+    return false;
+  }
+
+  // 80 MHz APB / 80 = 1 MHz timer ticks
+  timer_ = timerBegin(timerNum, 80, true);
+  timerAttachInterrupt(timer_, onTimer, true);
+  timerAlarmWrite(timer_, 1000000UL / sampleRateHz, true);
+  timerAlarmEnable(timer_);
+  return true;
+}
+
+void IRAM_ATTR LightSampler::onTimer()
+{
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(instance_->task_, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+void LightSampler::taskEntry(void* arg)
+{
+  static_cast<LightSampler*>(arg)->run();
+}
+
+void LightSampler::run()
+{
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    buffers_[active_][fill_++] = analogRead(pin_);
+    if (fill_ < windowSize_) {
+      continue;
+    }
+
+    fill_ = 0;
+    if (ready_ != -1) {
+      overruns_++;  // loop() has not read the previous window yet
+      continue;
+    }
+    readyAt_ = millis();
+    ready_ = active_;
+    active_ ^= 1;
+  }
+}
+
+bool LightSampler::read(LightWindow& window)
+{
+  int ready = ready_;
+  if (ready == -1) {
+    return false;
+  }
+
+  const uint16_t* samples = buffers_[ready];
+  uint32_t sum = 0;
+  uint16_t lo = 0xFFFF;
+  uint16_t hi = 0;
+  if (!emaValid_) {
+    emaScaled_ = (int32_t)samples[0] << 8;
+    emaValid_ = true;
+  }
+  for (size_t i = 0; i < windowSize_; i++) {
+    uint16_t v = samples[i];
+    sum += v;
+    if (v < lo) lo = v;
+    if (v > hi) hi = v;
+    emaScaled_ += (((int32_t)v << 8) - emaScaled_) >> emaShift_;
+  }
+
+  window.mean = sum / windowSize_;
+  window.min = lo;
+  window.max = hi;
+  window.ema = emaScaled_ >> 8;
+  window.count = windowSize_;
+  window.timestamp = readyAt_;
+
+  ready_ = -1;  // hand the buffer back to the sampler
+  return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Summary of one sampling window
+struct LightWindow {
+  uint16_t mean;
+  uint16_t min;
+  uint16_t max;
+  uint16_t ema;        // exponential moving average across windows
+  uint16_t count;      // samples in the window
+  uint32_t timestamp;  // millis() at the end of the window
+};
+
+/**
+ * Fixed-rate ADC sampling for the light sensor.
+ *
+ * A hardware timer fires at the sample rate and wakes a high-priority task
+ * that performs the analogRead() (the ADC driver cannot be used from the
+ * ISR itself). Samples fill one half of a double buffer while loop()
+ * decimates the other half with read(). If loop() falls a full window
+ * behind, the window being filled is discarded and counted as an overrun.
+ */
+class LightSampler {
+public:
+  static const size_t MAX_WINDOW = 128;
+
+  // emaShift sets the EMA weight: ema += (x - ema) / 2^emaShift per sample
+  bool begin(int pin, uint32_t sampleRateHz, size_t windowSize,
+             uint8_t timerNum = 0, uint8_t emaShift = 4, BaseType_t core = 1);
+
+  // Returns true and fills window when a new window is ready
+  bool read(LightWindow& window);
+
+  uint32_t overruns() const { return overruns_; }
+
+private:
+  static void IRAM_ATTR onTimer();
+  static void taskEntry(void* arg);
+  void run();
+
+  static LightSampler* instance_;
+
+  int pin_;
+  size_t windowSize_;
+  uint8_t emaShift_;
+  hw_timer_t* timer_;
+  TaskHandle_t task_;
+
+  uint16_t buffers_[2][MAX_WINDOW];
+  size_t active_;
+  size_t fill_;
+  volatile int ready_;              // index of the buffer awaiting read(), or -1
+  volatile uint32_t readyAt_;
+  volatile uint32_t overruns_;
+  int32_t emaScaled_;               // EMA << 8 for sub-count precision
+  bool emaValid_;
+};
@@ -0,0 +1,102 @@
+#include "Log.h"
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace {
+
+const size_t RING_SIZE = 4096;   // bytes of buffered log text
+const size_t LINE_SIZE = 160;    // longest single message
+
+char ring[RING_SIZE];
+size_t ringHead = 0;             // next byte to write
+size_t ringTail = 0;             // next byte to drain
+uint32_t dropped = 0;
+portMUX_TYPE ringLock = portMUX_INITIALIZER_UNLOCKED;
+
+Print* output = nullptr;
+TaskHandle_t drainTask = nullptr;
+
+const char LEVEL_TAGS[] = " EWID";
+
+void drain(void* arg)
+{
+  uint32_t reportedDrops = 0;
+  char chunk[128];
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+    for (;;) {
+      size_t n = 0;
+      portENTER_CRITICAL(&ringLock);
+      while (ringTail != ringHead && n < sizeof(chunk)) {
+        chunk[n++] = ring[ringTail];
+        ringTail = (ringTail + 1) % RING_SIZE;
+      }
+      uint32_t drops = dropped;
+      portEXIT_CRITICAL(&ringLock);
+
+      if (n == 0) {
+        if (drops != reportedDrops) {
+          output->printf("[W] log: %u messages dropped\r\n", (unsigned)(drops - reportedDrops));
+          reportedDrops = drops;
+        }
+        break;
+      }
+      output->write(reinterpret_cast<const uint8_t*>(chunk), n);  // may block; only this task waits
+    }
+  }
+}
+
+}  // namespace
+
+void logBegin(Print& out, UBaseType_t priority)
+{
+  output = &out;
+  if (drainTask == nullptr) {
+    xTaskCreate(drain, "log", 3072, nullptr, priority, &drainTask);
+  }
+}
+
+void logWrite(uint8_t level, const char* format, ...)
+{
+  char line[LINE_SIZE];
+  int len = snprintf(line, sizeof(line), "[%c] ", LEVEL_TAGS[level]);
+
+  va_list args;
+  va_start(args, format);
+  int body = vsnprintf(line + len, sizeof(line) - len - 2, format, args);
+  va_end(args);
+
+  len += body < 0 ? 0 : min((int)(sizeof(line) - len - 3), body);
+  line[len++] = '\r';
+  line[len++] = '\n';
+
+  portENTER_CRITICAL(&ringLock);
+  size_t used = (ringHead + RING_SIZE - ringTail) % RING_SIZE;
+  if (RING_SIZE - 1 - used < (size_t)len) {
+    dropped++;
+  }
+  else {
+    for (int i = 0; i < len; i++) {
+      ring[ringHead] = line[i];
+      ringHead = (ringHead + 1) % RING_SIZE;
+    }
+  }
+  portEXIT_CRITICAL(&ringLock);
+
+  if (drainTask != nullptr) {
+    xTaskNotifyGive(drainTask);
+  }
+}
+
+uint32_t logDropped()
+{
+  return dropped;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+
+/**
+ * Leveled, asynchronous logging.
+ *
+ * LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG format the message into a RAM ring
+ * buffer and return immediately; a low-priority task drains the ring to
+ * Serial. If the ring is full the message is dropped (and counted) rather
+ * than blocking the caller.
+ *
+ * The threshold is fixed at build time with -DLOG_LEVEL=LOG_LEVEL_xxx.
+ * Messages above it compile to nothing (their arguments are not even
+ * evaluated); LOG_LEVEL_NONE removes the logger entirely.
+ */
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+
+// Starts the drain task; messages logged before this are kept in the ring
+void logBegin(Print& out = Serial, UBaseType_t priority = 1);
+
+void logWrite(uint8_t level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Messages dropped because the ring was full
+uint32_t logDropped();
+
+#else
+
+inline void logBegin(Print& out = Serial, UBaseType_t priority = 1) {}
+inline uint32_t logDropped() { return 0; }
+
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
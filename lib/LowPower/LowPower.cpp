@@ -0,0 +1,56 @@
+#include "LowPower.h"
+
+#include <WiFi.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <sys/time.h>
+
+WakeCause wakeCause()
+{
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_UNDEFINED: return WAKE_POWER_ON;
+    case ESP_SLEEP_WAKEUP_TIMER:     return WAKE_TIMER;
+    case ESP_SLEEP_WAKEUP_EXT0:      return WAKE_PIN;
+    default:                         return WAKE_OTHER;
+  }
+}
+
+bool beginLightSleep(uint32_t cpuMhz)
+{
+  // Wake the radio only every listen interval (3 beacons) instead of every DTIM
+  WiFi.setSleep(WIFI_PS_MAX_MODEM);
+
+#if CONFIG_PM_ENABLE
+  esp_pm_config_esp32_t config = {};
+  config.max_freq_mhz = cpuMhz;
+  config.min_freq_mhz = cpuMhz;
+  config.light_sleep_enable = true;
+  if (esp_pm_configure(&config) == ESP_OK) {
+    return true;
+  }
+  // Core built without tickless idle: fixed frequency only
+  config.light_sleep_enable = false;
+  esp_pm_configure(&config);
+  return false;
+#else
+  setCpuFrequencyMhz(cpuMhz);
+  return false;
+#endif
+}
+
+void deepSleep(uint32_t sleepMs, int wakePin, int wakeLevel)
+{
+  WiFi.mode(WIFI_OFF);
+  esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+  if (wakePin >= 0) {
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)wakePin, wakeLevel);
+  }
+  esp_deep_sleep_start();
+}
+
+int64_t systemTimeMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
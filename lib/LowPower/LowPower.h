@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+
+/**
+ * Sleep helpers for battery-powered nodes.
+ *
+ * Light sleep (beginLightSleep): WiFi modem sleep keeps the station
+ * associated while the radio is off between AP beacons, and with the
+ * core's power management the CPU is also clock-gated whenever FreeRTOS
+ * is idle, e.g. inside delay(). Timers keep their time, but GPIO edges
+ * that happen while the CPU sleeps are not seen, so inputs are polled.
+ *
+ * Deep sleep (deepSleep): everything but the RTC domain is powered down and
+ * the chip starts again from setup() on wake. Only RTC_DATA_ATTR globals
+ * and the system time survive; keep the former plain structs, since
+ * constructors run again on every wake.
+ */
+enum WakeCause : uint8_t {
+  WAKE_POWER_ON,  // reset or first boot: RTC memory is zeroed
+  WAKE_TIMER,
+  WAKE_PIN,       // the ext0 pin reached its wake level
+  WAKE_OTHER
+};
+
+WakeCause wakeCause();
+
+// Enables WiFi modem sleep (call after WiFi.mode()) and runs the CPU at
+// cpuMhz (80 is the lowest that keeps WiFi working). Returns true if the
+// CPU light-sleeps when idle, false if the core's power management does
+// not support it and only the modem sleeps.
+bool beginLightSleep(uint32_t cpuMhz);
+
+// Turns WiFi off and sleeps for sleepMs, or until wakePin (an RTC GPIO)
+// reads wakeLevel when wakePin >= 0. Never returns.
+[[noreturn]] void deepSleep(uint32_t sleepMs, int wakePin, int wakeLevel);
+
+// System time in ms: since the epoch once SNTP has set it, since power-on
+// before that. Unlike millis() it keeps counting through deep sleep.
+int64_t systemTimeMs();
+
+// Time-weighted average of two current draws (any unit, e.g. uA)
+inline uint32_t averageCurrent(uint64_t aMs, uint32_t aCurrent, uint64_t bMs, uint32_t bCurrent)
+{
+  uint64_t totalMs = aMs + bMs;
+  return totalMs ? (uint32_t)((aMs * aCurrent + bMs * bCurrent) / totalMs) : 0;
+}
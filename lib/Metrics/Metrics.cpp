@@ -0,0 +1,153 @@
+#include "Metrics.h"
+
+#include <string.h>
+#include "Log.h"
+#include "MessageBuilder.h"
+
+LatencyHistogram::LatencyHistogram()
+  : lock_(portMUX_INITIALIZER_UNLOCKED),
+    count_(0),
+    sumUs_(0),
+    maxUs_(0)
+{
+  memset(buckets_, 0, sizeof(buckets_));
+}
+
+void LatencyHistogram::record(uint32_t startCycles)
+{
+  recordUs((cycleCount() - startCycles) / ESP.getCpuFreqMHz());
+}
+
+void LatencyHistogram::recordUs(uint32_t us)
+{
+  size_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= BUCKETS) {
+    bucket = BUCKETS - 1;
+  }
+
+  portENTER_CRITICAL(&lock_);
+  buckets_[bucket]++;
+  count_++;
+  sumUs_ += us;
+  if (us > maxUs_) {
+    maxUs_ = us;
+  }
+  portEXIT_CRITICAL(&lock_);
+}
+
+LatencyHistogram::Summary LatencyHistogram::takeSummary()
+{
+  uint32_t buckets[BUCKETS];
+  Summary summary;
+
+  portENTER_CRITICAL(&lock_);
+  memcpy(buckets, buckets_, sizeof(buckets));
+  summary.count = count_;
+  summary.meanUs = count_ ? (uint32_t)(sumUs_ / count_) : 0;
+  summary.maxUs = maxUs_;
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  sumUs_ = 0;
+  maxUs_ = 0;
+  portEXIT_CRITICAL(&lock_);
+
+  summary.p50Us = percentile(buckets, summary.count, 500);
+  summary.p99Us = percentile(buckets, summary.count, 990);
+  // A bucket bound can overshoot the largest value actually seen
+  if (summary.p50Us > summary.maxUs) {
+    summary.p50Us = summary.maxUs;
+  }
+  if (summary.p99Us > summary.maxUs) {
+    summary.p99Us = summary.maxUs;
+  }
+  return summary;
+}
+
+uint32_t LatencyHistogram::percentile(const uint32_t* buckets, uint32_t count, uint32_t permille)
+{
+  if (count == 0) {
+    return 0;
+  }
+  uint32_t rank = (uint32_t)(((uint64_t)count * permille + 999) / 1000);
+  uint32_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return i == BUCKETS - 1 ? UINT32_MAX : (1u << i);
+    }
+  }
+  return UINT32_MAX;
+}
+
+Metrics::Metrics(unsigned long intervalMs)
+  : intervalMs_(intervalMs),
+    lastReport_(0),
+    histogramCount_(0),
+    counterCount_(0),
+    timebase_(nullptr),
+    seq_(0)
+{
+}
+
+bool Metrics::addHistogram(const char* name, LatencyHistogram& histogram)
+{
+  if (histogramCount_ >= MAX_HISTOGRAMS) {
+    return false;
+  }
+  histograms_[histogramCount_++] = { name, &histogram };
+  return true;
+}
+
+bool Metrics::addCounter(const char* name, CounterFn counter)
+{
+  if (counterCount_ >= MAX_COUNTERS) {
+    return false;
+  }
+  counters_[counterCount_++] = { name, counter };
+  return true;
+}
+
+void Metrics::loop(PubSubClient& mqtt, const char* topic)
+{
+  unsigned long now = millis();
+  if (now - lastReport_ < intervalMs_ || !mqtt.connected()) {
+    return;
+  }
+  lastReport_ = now;
+
+  static char message[768];
+  size_t length = encode(message, sizeof(message));
+  if (length == 0 || !mqtt.publish(topic, reinterpret_cast<const uint8_t*>(message), length)) {
+    LOG_WARN("Failed to publish metrics");
+  }
+}
+
+size_t Metrics::encode(char* out, size_t size)
+{
+  // Metrics are always JSON, whatever the telemetry encoding
+  JsonDocument& doc = telemetryBuilder().reset();
+  uint32_t now = millis();
+  doc["seq"] = seq_++;
+  doc["timestamp"] = timebase_ ? timebase_().toEpoch(now) : (int64_t)now;
+  doc["uptime_s"] = now / 1000;
+  doc["heap_free"] = ESP.getFreeHeap();
+  doc["heap_min"] = ESP.getMinFreeHeap();
+
+  for (size_t i = 0; i < histogramCount_; i++) {
+    LatencyHistogram::Summary summary = histograms_[i].histogram->takeSummary();
+    JsonObject entry = doc[histograms_[i].name].to<JsonObject>();
+    entry["count"] = summary.count;
+    entry["mean"] = summary.meanUs;
+    entry["p50"] = summary.p50Us;
+    entry["p99"] = summary.p99Us;
+    entry["max"] = summary.maxUs;
+  }
+  for (size_t i = 0; i < counterCount_; i++) {
+    doc[counters_[i].name] = counters_[i].counter();
+  }
+
+  if (doc.overflowed() || measureJson(doc) >= size) {
+    return 0;
+  }
+  return serializeJson(doc, out, size);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <freertos/FreeRTOS.h>
+#include "TelemetryCodec.h"
+
+/**
+ * Lightweight runtime instrumentation.
+ *
+ * Code paths are timed with the CPU cycle counter (a single register read)
+ * into log2-bucketed latency histograms. Metrics periodically publishes
+ * those histograms together with free/minimum heap and any registered
+ * counters as one JSON message, then starts a fresh window.
+ *
+ *   uint32_t start = cycleCount();
+ *   connection.loop();
+ *   mqttLatency.record(start);
+ */
+
+inline uint32_t cycleCount() { return ESP.getCycleCount(); }
+
+// Latency distribution in microseconds, bucket i counting values in
+// [2^(i-1), 2^i). Safe to record from one core while another reports.
+class LatencyHistogram {
+public:
+  static const size_t BUCKETS = 24;  // up to ~8 s, the last bucket is open-ended
+
+  LatencyHistogram();
+
+  // Records the time elapsed since startCycles (from cycleCount())
+  void record(uint32_t startCycles);
+  void recordUs(uint32_t us);
+
+  struct Summary {
+    uint32_t count;
+    uint32_t meanUs;
+    uint32_t p50Us;  // bucket upper bounds
+    uint32_t p99Us;
+    uint32_t maxUs;
+  };
+  // Summarizes the current window and starts a new one
+  Summary takeSummary();
+
+private:
+  static uint32_t percentile(const uint32_t* buckets, uint32_t count, uint32_t permille);
+
+  portMUX_TYPE lock_;
+  uint32_t buckets_[BUCKETS];
+  uint32_t count_;
+  uint64_t sumUs_;
+  uint32_t maxUs_;
+};
+
+class Metrics {
+public:
+  // Returns the current value of a counter (e.g. a getter on a global)
+  typedef uint32_t (*CounterFn)();
+  // Returns the current wall-clock snapshot for message timestamps
+  typedef Timebase (*TimebaseFn)();
+
+  static const size_t MAX_HISTOGRAMS = 4;
+  static const size_t MAX_COUNTERS = 12;
+
+  explicit Metrics(unsigned long intervalMs);
+
+  // Names must outlive the Metrics object (string literals)
+  bool addHistogram(const char* name, LatencyHistogram& histogram);
+  bool addCounter(const char* name, CounterFn counter);
+
+  // Stamps messages with epoch ms from this clock (ms since boot without one)
+  void setTimebase(TimebaseFn timebase) { timebase_ = timebase; }
+
+  // Publishes a metrics message on topic once per interval while connected
+  void loop(PubSubClient& mqtt, const char* topic);
+
+  // Builds the JSON message; returns its length, or 0 if it did not fit
+  size_t encode(char* out, size_t size);
+
+private:
+  struct NamedHistogram {
+    const char* name;
+    LatencyHistogram* histogram;
+  };
+  struct NamedCounter {
+    const char* name;
+    CounterFn counter;
+  };
+
+  unsigned long intervalMs_;
+  unsigned long lastReport_;
+  NamedHistogram histograms_[MAX_HISTOGRAMS];
+  size_t histogramCount_;
+  NamedCounter counters_[MAX_COUNTERS];
+  size_t counterCount_;
+  TimebaseFn timebase_;
+  uint32_t seq_;
+};
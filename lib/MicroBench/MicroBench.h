@@ -0,0 +1,102 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Minimal microbenchmark runner for the native build (the same idea as
+ * Google Benchmark, without the dependency).
+ *
+ *   MICROBENCH(dispatchLedTopic)
+ *   {
+ *     for (uint64_t i = 0; i < iterations; i++) {
+ *       microbench::doNotOptimize(dispatcher.find(topic));
+ *     }
+ *   }
+ *
+ * Each benchmark is called with a growing iteration count until one run
+ * takes at least MIN_RUN_NS; the time per iteration of that run is
+ * reported. microbench::runAll() takes an optional name filter (substring).
+ */
+namespace microbench {
+
+typedef void (*BenchFn)(uint64_t iterations);
+
+const uint64_t MIN_RUN_NS = 200000000;  // 0.2 s
+const size_t MAX_BENCHMARKS = 64;
+
+struct Benchmark {
+  const char* name;
+  BenchFn fn;
+};
+
+inline Benchmark* registry(size_t*& count)
+{
+  static Benchmark benchmarks[MAX_BENCHMARKS];
+  static size_t registered = 0;
+  count = &registered;
+  return benchmarks;
+}
+
+struct Registration {
+  Registration(const char* name, BenchFn fn)
+  {
+    size_t* count;
+    Benchmark* benchmarks = registry(count);
+    if (*count < MAX_BENCHMARKS) {
+      benchmarks[(*count)++] = { name, fn };
+    }
+  }
+};
+
+// Keeps the compiler from discarding a computed value
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline uint64_t nowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int runAll(int argc, char** argv)
+{
+  const char* filter = argc > 1 ? argv[1] : nullptr;
+  size_t* count;
+  Benchmark* benchmarks = registry(count);
+
+  printf("%-32s %14s %12s\n", "benchmark", "iterations", "ns/op");
+  for (size_t b = 0; b < *count; b++) {
+    if (filter != nullptr && strstr(benchmarks[b].name, filter) == nullptr) {
+      continue;
+    }
+    uint64_t iterations = 1;
+    uint64_t elapsed = 0;
+    for (;;) {
+      uint64_t start = nowNs();
+      benchmarks[b].fn(iterations);
+      elapsed = nowNs() - start;
+      if (elapsed >= MIN_RUN_NS || iterations >= (1ULL << 40)) {
+        break;
+      }
+      // Aim just past the minimum run time, growing at most 10x per step
+      uint64_t next = elapsed > 0 ? iterations * MIN_RUN_NS * 12 / 10 / elapsed : iterations * 10;
+      iterations = next > iterations * 10 ? iterations * 10 : (next > iterations ? next : iterations + 1);
+    }
+    printf("%-32s %14llu %12.1f\n", benchmarks[b].name,
+           (unsigned long long)iterations, (double)elapsed / iterations);
+  }
+  return 0;
+}
+
+}  // namespace microbench
+
+#define MICROBENCH(name)                                                  \
+  static void name(uint64_t iterations);                                  \
+  static microbench::Registration name##Registration(#name, name);         \
+  static void name(uint64_t iterations)
@@ -0,0 +1,145 @@
+#pragma once
+
+/**
+ * Per-node build configuration: which hardware a node has, its pins, its
+ * device id (and so its topics), and the WiFi and broker settings.
+ *
+ * A node profile is selected at build time:
+ *
+ *   -DNODE_PROFILE=NODE_PROFILE_LAB_BOARD     (default) full lab kit: light
+ *                                             sensor, button, 4 LEDs, I2C LCD
+ *   -DNODE_PROFILE=NODE_PROFILE_WOKWI         the same kit in the Wokwi
+ *                                             simulator (Wokwi-GUEST WiFi)
+ *   -DNODE_PROFILE=NODE_PROFILE_SENSOR_NODE   light sensor and button only
+ *   -DNODE_PROFILE=NODE_PROFILE_ACTUATOR_NODE LEDs and LCD only
+ *
+ * A sketch may pick its own default profile by defining NODE_PROFILE before
+ * including this header. Every value below can also be overridden on its
+ * own, e.g. '-DNODE_ID="node07"' or -DNODE_PIN_BUTTON=4.
+ *
+ * Everything is a macro, so it is known at compile time: topics are string
+ * literals, and sketches compile a feature out entirely with
+ * #if NODE_HAS_xxx when the node lacks it.
+ */
+#define NODE_PROFILE_LAB_BOARD     0
+#define NODE_PROFILE_WOKWI         1
+#define NODE_PROFILE_SENSOR_NODE   2
+#define NODE_PROFILE_ACTUATOR_NODE 3
+
+#ifndef NODE_PROFILE
+#define NODE_PROFILE NODE_PROFILE_LAB_BOARD
+#endif
+
+// What each profile changes from the lab board defaults further down
+#if NODE_PROFILE == NODE_PROFILE_WOKWI
+#ifndef NODE_WIFI_SSID
+#define NODE_WIFI_SSID "Wokwi-GUEST"
+#endif
+#ifndef NODE_WIFI_PASSWORD
+#define NODE_WIFI_PASSWORD ""
+#endif
+#elif NODE_PROFILE == NODE_PROFILE_SENSOR_NODE
+#ifndef NODE_HAS_LEDS
+#define NODE_HAS_LEDS 0
+#endif
+#ifndef NODE_HAS_LCD
+#define NODE_HAS_LCD 0
+#endif
+#elif NODE_PROFILE == NODE_PROFILE_ACTUATOR_NODE
+#ifndef NODE_HAS_SENSOR
+#define NODE_HAS_SENSOR 0
+#endif
+#ifndef NODE_HAS_BUTTON
+#define NODE_HAS_BUTTON 0
+#endif
+#elif NODE_PROFILE != NODE_PROFILE_LAB_BOARD
+#error "Unknown NODE_PROFILE"
+#endif
+
+// Identity: every topic is NODE_TOPIC_ROOT "/" <suffix>
+#ifndef NODE_ID
+#define NODE_ID "maqsud"
+#endif
+#ifndef NODE_TOPIC_ROOT
+#define NODE_TOPIC_ROOT "ttpu/iot/" NODE_ID
+#endif
+#define NODE_TOPIC(suffix) NODE_TOPIC_ROOT "/" suffix
+
+// WiFi and broker
+#ifndef NODE_WIFI_SSID
+#define NODE_WIFI_SSID "MaxPC"
+#endif
+#ifndef NODE_WIFI_PASSWORD
+#define NODE_WIFI_PASSWORD "polito2025"
+#endif
+#ifndef NODE_MQTT_BROKER
+#define NODE_MQTT_BROKER "mqtt.iotserver.uz"  // Free public MQTT broker
+#endif
+#ifndef NODE_MQTT_PORT
+#define NODE_MQTT_PORT 1883
+#endif
+#ifndef NODE_MQTT_USERNAME
+#define NODE_MQTT_USERNAME "userTTPU"  // username given in the telegram group
+#endif
+#ifndef NODE_MQTT_PASSWORD
+#define NODE_MQTT_PASSWORD "mqttpass"  // password given in the telegram group
+#endif
+
+// Features (1 = fitted and built in)
+#ifndef NODE_HAS_SENSOR
+#define NODE_HAS_SENSOR 1  // analog light sensor
+#endif
+#ifndef NODE_HAS_BUTTON
+#define NODE_HAS_BUTTON 1
+#endif
+#ifndef NODE_HAS_LEDS
+#define NODE_HAS_LEDS 1    // red, green, blue and yellow LEDs
+#endif
+#ifndef NODE_HAS_LCD
+#define NODE_HAS_LCD 1     // 16x2 HD44780 behind a PCF8574 I2C backpack
+#endif
+#ifndef NODE_HAS_OTA
+#define NODE_HAS_OTA 1     // firmware updates on the ota topic (see OtaUpdate.h)
+#endif
+
+// Firmware updates: the key the commands are signed with, shared with
+// client/ota.py; updates are rejected while it is empty
+#ifndef NODE_OTA_KEY
+#define NODE_OTA_KEY ""
+#endif
+// Version of this build; an update is only accepted for a higher one, so
+// raise it for every image rolled out (client/ota.py --version)
+#ifndef NODE_FIRMWARE_VERSION
+#define NODE_FIRMWARE_VERSION 0
+#endif
+
+// Pins
+#ifndef NODE_PIN_LIGHT
+#define NODE_PIN_LIGHT 33       // ADC1
+#endif
+#ifndef NODE_PIN_BUTTON
+#define NODE_PIN_BUTTON 25      // active high; an RTC GPIO, so it can wake deep sleep
+#endif
+#ifndef NODE_PIN_LED_RED
+#define NODE_PIN_LED_RED 26
+#endif
+#ifndef NODE_PIN_LED_GREEN
+#define NODE_PIN_LED_GREEN 27
+#endif
+#ifndef NODE_PIN_LED_BLUE
+#define NODE_PIN_LED_BLUE 14
+#endif
+#ifndef NODE_PIN_LED_YELLOW
+#define NODE_PIN_LED_YELLOW 12
+#endif
+
+// LCD (I2C on the default SDA 21 / SCL 22)
+#ifndef NODE_LCD_I2C_ADDRESS
+#define NODE_LCD_I2C_ADDRESS 0x27  // used by PcfLcd; hd44780_I2Cexp auto-detects
+#endif
+#ifndef NODE_LCD_COLS
+#define NODE_LCD_COLS 16
+#endif
+#ifndef NODE_LCD_ROWS
+#define NODE_LCD_ROWS 2
+#endif
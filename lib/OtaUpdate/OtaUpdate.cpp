@@ -0,0 +1,419 @@
+#include "OtaUpdate.h"
+
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mbedtls/md.h>
+#include <string.h>
+#include "Log.h"
+#include "PayloadParser.h"
+
+namespace {
+const char* NVS_NAMESPACE = "ota";
+const char* KEY_BOOTS = "boots";        // unconfirmed boots of a new image; absent when none
+const char* KEY_PREVIOUS = "prev";      // partition label of the image we updated from
+const char* KEY_REVERTED = "reverted";  // set when rolling back, reported by the old image
+const char* KEY_INSTALLED = "version";  // highest firmware version ever written by an update
+
+const char* const STATE_NAMES[] = {
+  "idle", "downloading", "rebooting", "failed", "verifying", "confirmed", "rolled_back",
+};
+
+// Parses exactly 2 * size hex digits
+bool parseHex(const char* hex, uint8_t* out, size_t size)
+{
+  if (strlen(hex) != 2 * size) {
+    return false;
+  }
+  for (size_t i = 0; i < 2 * size; i++) {
+    char c = hex[i];
+    uint8_t nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    out[i / 2] = (i % 2 == 0) ? nibble << 4 : out[i / 2] | nibble;
+  }
+  return true;
+}
+
+// HMAC-SHA256(key, version "\n" url "\n" sha256Hex), compared in constant time
+bool signatureValid(const char* key, uint32_t version, const char* url, const char* sha256Hex,
+                    const uint8_t* sig)
+{
+  char versionText[11];
+  snprintf(versionText, sizeof(versionText), "%lu", (unsigned long)version);
+  const mbedtls_md_info_t* info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+  mbedtls_md_context_t ctx;
+  mbedtls_md_init(&ctx);
+  uint8_t expected[32];
+  bool ok = mbedtls_md_setup(&ctx, info, 1) == 0
+            && mbedtls_md_hmac_starts(&ctx, (const uint8_t*)key, strlen(key)) == 0
+            && mbedtls_md_hmac_update(&ctx, (const uint8_t*)versionText, strlen(versionText)) == 0
+            && mbedtls_md_hmac_update(&ctx, (const uint8_t*)"\n", 1) == 0
+            && mbedtls_md_hmac_update(&ctx, (const uint8_t*)url, strlen(url)) == 0
+            && mbedtls_md_hmac_update(&ctx, (const uint8_t*)"\n", 1) == 0
+            && mbedtls_md_hmac_update(&ctx, (const uint8_t*)sha256Hex, strlen(sha256Hex)) == 0
+            && mbedtls_md_hmac_finish(&ctx, expected) == 0;
+  mbedtls_md_free(&ctx);
+  if (!ok) {
+    return false;
+  }
+  uint8_t diff = 0;
+  for (size_t i = 0; i < sizeof(expected); i++) {
+    diff |= expected[i] ^ sig[i];
+  }
+  return diff == 0;
+}
+}
+
+// Read by the Arduino core at boot: keeps a freshly updated image
+// pending-verify until confirm() when the bootloader has rollback enabled
+extern "C" bool verifyRollbackLater()
+{
+  return true;
+}
+
+OtaUpdater::OtaUpdater(const char* key, uint32_t version)
+  : key_(key),
+    version_(version),
+    minVersion_(version),
+    imageVersion_(0),
+    state_(OTA_IDLE),
+    progress_(0),
+    statusDue_(false),
+    error_(nullptr),
+    reportedState_(OTA_IDLE),
+    reportedProgress_(0),
+    rebootArmed_(false),
+    rebootFrom_(0),
+    confirmed_(false),
+    confirmTimeoutMs_(0)
+{
+  url_[0] = '\0';
+}
+
+void OtaUpdater::begin(unsigned long confirmTimeoutMs)
+{
+  confirmTimeoutMs_ = confirmTimeoutMs;
+
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) {
+    return;
+  }
+  // An image we already installed stays refused after it is rolled back
+  uint32_t installed = prefs.getULong(KEY_INSTALLED, 0);
+  if (installed > minVersion_) {
+    minVersion_ = installed;
+  }
+  if (prefs.getBool(KEY_REVERTED, false)) {
+    prefs.remove(KEY_REVERTED);
+    state_ = OTA_ROLLED_BACK;
+    statusDue_ = true;
+  }
+  else if (prefs.isKey(KEY_BOOTS)) {
+    uint8_t boots = prefs.getUChar(KEY_BOOTS, 0) + 1;
+    prefs.putUChar(KEY_BOOTS, boots);
+    if (boots > MAX_UNCONFIRMED_BOOTS) {
+      prefs.end();
+      rollback("new firmware keeps resetting");
+      return;
+    }
+    LOG_INFO("New firmware on probation (boot %u)", (unsigned)boots);
+    state_ = OTA_VERIFYING;
+    statusDue_ = true;
+  }
+  prefs.end();
+}
+
+bool OtaUpdater::handleCommand(const uint8_t* payload, size_t length)
+{
+  State current = state_;
+  if (current == OTA_DOWNLOADING || current == OTA_REBOOTING || current == OTA_VERIFYING) {
+    LOG_WARN("OTA command ignored: %s", current == OTA_VERIFYING ? "running image not confirmed yet"
+                                                                  : "update in progress");
+    return false;
+  }
+  if (key_ == nullptr || key_[0] == '\0') {
+    fail("updates disabled (no key)");
+    return false;
+  }
+
+  JsonToken url, sha256, sig;
+  uint32_t version;
+  if (!jsonFindString(payload, length, "url", url) || !jsonFindString(payload, length, "sha256", sha256)
+      || !jsonFindString(payload, length, "sig", sig) || !jsonFindUint(payload, length, "version", version)) {
+    fail("malformed command");
+    return false;
+  }
+  if (url.len >= sizeof(url_)) {
+    fail("url too long");
+    return false;
+  }
+  char sha256Hex[65];
+  char sigHex[65];
+  uint8_t sigBytes[32];
+  tokenCopy(url, url_, sizeof(url_));
+  tokenCopy(sha256, sha256Hex, sizeof(sha256Hex));
+  tokenCopy(sig, sigHex, sizeof(sigHex));
+  if (sha256.len != 64 || sig.len != 64 || !parseHex(sha256Hex, sha256_, sizeof(sha256_))
+      || !parseHex(sigHex, sigBytes, sizeof(sigBytes))) {
+    fail("malformed command");
+    return false;
+  }
+  if (!signatureValid(key_, version, url_, sha256Hex, sigBytes)) {
+    fail("bad signature");
+    return false;
+  }
+  // A genuine but old command (replayed from the broker) would downgrade us
+  if (version <= minVersion_) {
+    LOG_WARN("OTA command for version %lu ignored (at %lu)", (unsigned long)version,
+             (unsigned long)minVersion_);
+    fail("not newer than the running firmware");
+    return false;
+  }
+  if (strncmp(url_, "http://", 7) != 0 && strncmp(url_, "https://", 8) != 0) {
+    fail("unsupported url");
+    return false;
+  }
+
+  LOG_INFO("Firmware update to version %lu from %s", (unsigned long)version, url_);
+  imageVersion_ = version;
+  error_ = nullptr;
+  progress_ = 0;
+  state_ = OTA_DOWNLOADING;
+  // Next to the WiFi stack, below the sketch's own tasks (the stack leaves
+  // room for a TLS handshake)
+  if (xTaskCreatePinnedToCore(downloadTask, "ota", 12288, this, 1, nullptr, 0) != pdPASS) {
+    fail("no memory for the download task");
+    return false;
+  }
+  return true;
+}
+
+void OtaUpdater::loop()
+{
+  State current = state_;
+  unsigned long now = millis();
+
+  if (current == OTA_REBOOTING) {
+    if (!rebootArmed_) {
+      rebootArmed_ = true;
+      rebootFrom_ = now;
+    }
+    else if (now - rebootFrom_ >= REBOOT_DELAY_MS) {
+      LOG_INFO("Restarting into the new firmware");
+      ESP.restart();
+    }
+  }
+  else if (current == OTA_VERIFYING && now >= confirmTimeoutMs_) {
+    rollback("new firmware was not confirmed in time");
+  }
+}
+
+void OtaUpdater::confirm()
+{
+  if (confirmed_) {
+    return;
+  }
+  confirmed_ = true;
+#if CONFIG_APP_ROLLBACK_ENABLE
+  esp_ota_mark_app_valid_cancel_rollback();
+#endif
+  if (state_ != OTA_VERIFYING) {
+    return;
+  }
+
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.remove(KEY_BOOTS);
+    prefs.remove(KEY_PREVIOUS);
+    prefs.end();
+  }
+  LOG_INFO("New firmware confirmed");
+  state_ = OTA_CONFIRMED;
+}
+
+size_t OtaUpdater::takeStatus(char* out, size_t size)
+{
+  State current = state_;
+  uint8_t percent = progress_;
+  if (!statusDue_ && current == reportedState_ && percent / 10 == reportedProgress_ / 10) {
+    return 0;
+  }
+  statusDue_ = false;
+  reportedState_ = current;
+  reportedProgress_ = percent;
+
+  const char* error = current == OTA_FAILED ? error_ : nullptr;
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  int n = snprintf(out, size,
+                   "{\"state\":\"%s\",\"progress\":%u,\"error\":%s%s%s,\"partition\":\"%s\",\"version\":%lu}",
+                   STATE_NAMES[current], (unsigned)percent,
+                   error ? "\"" : "", error ? error : "null", error ? "\"" : "",
+                   running ? running->label : "", (unsigned long)version_);
+  return n > 0 && (size_t)n < size ? n : 0;
+}
+
+void OtaUpdater::downloadTask(void* arg)
+{
+  static_cast<OtaUpdater*>(arg)->download();
+  vTaskDelete(nullptr);
+}
+
+void OtaUpdater::download()
+{
+  HTTPClient http;
+  http.setTimeout(READ_TIMEOUT_MS);
+  if (!http.begin(url_)) {
+    fail("bad url");
+    return;
+  }
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    LOG_WARN("Firmware download failed: HTTP %d", code);
+    http.end();
+    fail("download failed");
+    return;
+  }
+  // The loop below reads the raw socket, which is only the image itself
+  // when the server sends it with a length (not chunked)
+  int total = http.getSize();
+  if (total <= 0) {
+    http.end();
+    fail("no content length");
+    return;
+  }
+  if (!Update.begin(total)) {
+    http.end();
+    fail("image does not fit");
+    return;
+  }
+
+  mbedtls_md_context_t hash;
+  mbedtls_md_init(&hash);
+  mbedtls_md_setup(&hash, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0);
+  mbedtls_md_starts(&hash);
+
+  // Straight from the socket to flash, one TCP segment at a time
+  WiFiClient* stream = http.getStreamPtr();
+  uint8_t buffer[1436];
+  size_t written = 0;
+  unsigned long lastDataAt = millis();
+  const char* error = nullptr;
+  while (written < (size_t)total) {
+    int available = stream->available();
+    if (available <= 0) {
+      if (!stream->connected()) {
+        error = "download incomplete";
+        break;
+      }
+      if (millis() - lastDataAt > READ_TIMEOUT_MS) {
+        error = "download stalled";
+        break;
+      }
+      vTaskDelay(1);
+      continue;
+    }
+    size_t want = (size_t)total - written;
+    if ((size_t)available < want) {
+      want = available;
+    }
+    int n = stream->read(buffer, want < sizeof(buffer) ? want : sizeof(buffer));
+    if (n <= 0) {
+      continue;
+    }
+    mbedtls_md_update(&hash, buffer, n);
+    if (Update.write(buffer, n) != (size_t)n) {
+      error = "flash write failed";
+      break;
+    }
+    written += n;
+    lastDataAt = millis();
+    progress_ = (uint8_t)(written * 100 / total);
+  }
+  http.end();
+
+  uint8_t digest[32];
+  mbedtls_md_finish(&hash, digest);
+  mbedtls_md_free(&hash);
+  if (error == nullptr && memcmp(digest, sha256_, sizeof(digest)) != 0) {
+    error = "sha256 mismatch";
+  }
+  if (error != nullptr) {
+    Update.abort();
+    fail(error);
+    return;
+  }
+  // Checks the image header and makes the new partition the boot partition
+  if (!Update.end(true)) {
+    fail("image rejected");
+    return;
+  }
+
+  // Probation state for the new image, see begin()
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.putString(KEY_PREVIOUS, running->label);
+    prefs.putUChar(KEY_BOOTS, 0);
+    prefs.putULong(KEY_INSTALLED, imageVersion_);
+    prefs.end();
+  }
+  minVersion_ = imageVersion_;
+  LOG_INFO("Firmware update written (%u bytes)", (unsigned)written);
+  progress_ = 100;
+  state_ = OTA_REBOOTING;
+}
+
+void OtaUpdater::fail(const char* error)
+{
+  LOG_WARN("Firmware update failed: %s", error);
+  error_ = error;
+  state_ = OTA_FAILED;
+  statusDue_ = true;
+}
+
+void OtaUpdater::rollback(const char* reason)
+{
+  LOG_ERROR("Rolling back firmware: %s", reason);
+
+  char previousLabel[17] = "";
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.getString(KEY_PREVIOUS, previousLabel, sizeof(previousLabel));
+    prefs.remove(KEY_BOOTS);
+    prefs.remove(KEY_PREVIOUS);
+    prefs.putBool(KEY_REVERTED, true);
+    prefs.end();
+  }
+
+#if CONFIG_APP_ROLLBACK_ENABLE
+  // Marks this image invalid and restarts into the previous one; returns
+  // only if this image was not pending verification
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+#endif
+  const esp_partition_t* previous = previousLabel[0] == '\0' ? nullptr
+    : esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, previousLabel);
+  if (previous == nullptr || esp_ota_set_boot_partition(previous) != ESP_OK) {
+    // Nothing to go back to: keep this image and end its probation
+    if (prefs.begin(NVS_NAMESPACE, false)) {
+      prefs.remove(KEY_REVERTED);
+      prefs.end();
+    }
+#if CONFIG_APP_ROLLBACK_ENABLE
+    esp_ota_mark_app_valid_cancel_rollback();
+#endif
+    fail("no previous firmware to roll back to");
+    return;
+  }
+  ESP.restart();
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+
+/**
+ * Firmware updates pulled over HTTP on an MQTT command, with rollback.
+ *
+ * The command is {"version":N,"url":"http://host/firmware.bin",
+ * "sha256":"<64 hex>","sig":"<64 hex>"}, where sig is
+ * HMAC-SHA256(key, N + "\n" + url + "\n" + sha256) with the key this
+ * firmware was built with and N the version of the image; unsigned or
+ * mis-signed commands are ignored, so nobody else on the broker can push an
+ * image. N must be above the running version and above any version an
+ * earlier update installed (kept in NVS), so a command seen on the broker
+ * cannot be replayed to downgrade a node or to reinstall an image that was
+ * rolled back. client/ota.py serves an image and sends the command.
+ *
+ * handleCommand() only validates the command and starts a download task,
+ * so the sketch keeps running (and publishing) during the update. The
+ * image, which the server must send with a Content-Length, is streamed
+ * through a 1.4 KB buffer straight into the inactive OTA partition and
+ * hashed on the way; it is only made bootable if the hash
+ * matches. loop() then restarts the node into it.
+ *
+ * A new image starts on probation: it must call confirm() (e.g. once it
+ * has reached the broker) within the confirm timeout given to begin(),
+ * or the previous image is made bootable again and the node restarts into
+ * it. The same happens if the new image resets MAX_UNCONFIRMED_BOOTS times
+ * before confirming. With the bootloader's own rollback enabled
+ * (CONFIG_APP_ROLLBACK_ENABLE), the image also stays pending-verify until
+ * confirm(), so even a crash before begin() reverts it.
+ *
+ * Progress and outcome are reported through takeStatus() for the sketch to
+ * publish; after a rollback the previous image reports "rolled_back".
+ */
+class OtaUpdater {
+public:
+  enum State : uint8_t {
+    OTA_IDLE,
+    OTA_DOWNLOADING,
+    OTA_REBOOTING,    // image written and verified, restart pending
+    OTA_FAILED,       // see error(); the running image is untouched
+    OTA_VERIFYING,    // new image on probation, waiting for confirm()
+    OTA_CONFIRMED,    // new image confirmed
+    OTA_ROLLED_BACK   // the image we had updated to was reverted
+  };
+
+  static const uint8_t MAX_UNCONFIRMED_BOOTS = 3;
+  static const unsigned long REBOOT_DELAY_MS = 1000;  // time to publish the last status
+  static const unsigned long READ_TIMEOUT_MS = 10000; // stalled download
+
+  // key signs the commands; an empty key rejects every command. version is
+  // the running firmware's (NODE_FIRMWARE_VERSION), see the class comment
+  OtaUpdater(const char* key, uint32_t version);
+
+  // Call early in setup(): starts the probation of a freshly updated image
+  // (or rolls it back after too many unconfirmed boots)
+  void begin(unsigned long confirmTimeoutMs);
+
+  // An update command payload, e.g. from the MQTT callback; false if it was
+  // rejected (see error())
+  bool handleCommand(const uint8_t* payload, size_t length);
+
+  // From the network path: restarts after a finished download, rolls back
+  // when the probation expires
+  void loop();
+
+  // The running image works; ends its probation (no-op otherwise)
+  void confirm();
+
+  State state() const { return state_; }
+  uint8_t progress() const { return progress_; }  // percent of the download
+  const char* error() const { return error_; }
+
+  // Formats {"state":"...","progress":N,"error":...,"partition":"...",
+  // "version":N} into out if the state or progress (in 10% steps) changed
+  // since the last call; returns the length, or 0 if there is nothing new
+  size_t takeStatus(char* out, size_t size);
+
+private:
+  static void downloadTask(void* arg);
+  void download();
+  void fail(const char* error);
+  void rollback(const char* reason);
+
+  const char* key_;
+  uint32_t version_;       // of the running image
+  uint32_t minVersion_;    // commands must be newer than this
+  uint32_t imageVersion_;  // of the image being downloaded
+  char url_[256];
+  uint8_t sha256_[32];
+
+  // Written by the download task, read by the sketch
+  std::atomic<State> state_;
+  std::atomic<uint8_t> progress_;
+  std::atomic<bool> statusDue_;  // report even if state and progress look unchanged
+  const char* volatile error_;
+
+  State reportedState_;
+  uint8_t reportedProgress_;
+  bool rebootArmed_;
+  unsigned long rebootFrom_;
+  bool confirmed_;
+  unsigned long confirmTimeoutMs_;  // probation length, from boot
+};
@@ -0,0 +1,257 @@
+#include "Outbox.h"
+
+#include <LittleFS.h>
+#include "Log.h"
+
+Outbox::Outbox(unsigned long drainIntervalMs)
+  : head_(0),
+    used_(0),
+    ramCount_(0),
+    spillPath_(nullptr),
+    spillLimit_(0),
+    spillRead_(0),
+    spillSize_(0),
+    spillPaused_(false),
+    drainIntervalMs_(drainIntervalMs),
+    lastDrain_(0),
+    dropped_(0),
+    sent_(0),
+    failed_(0),
+    payloadLength_(0)
+{
+  topic_[0] = '\0';
+}
+
+bool Outbox::beginSpill(const char* path, size_t limit)
+{
+  if (!LittleFS.begin(true)) {
+    LOG_WARN("Outbox: LittleFS mount failed, queueing in RAM only");
+    return false;
+  }
+
+  spillPath_ = path;
+  spillLimit_ = limit;
+  spillRead_ = 0;
+  spillSize_ = 0;
+
+  // Messages spilled before a reset are still waiting to be sent
+  if (LittleFS.exists(path)) {
+    File file = LittleFS.open(path, "r");
+    if (file) {
+      spillSize_ = file.size();
+      file.close();
+    }
+    if (spillSize_ > 0) {
+      LOG_INFO("Outbox: %u bytes of queued messages found in %s", (unsigned)spillSize_, path);
+    }
+  }
+  return true;
+}
+
+bool Outbox::publish(PubSubClient& mqtt, const char* topic, const uint8_t* payload, size_t length)
+{
+  // Only bypass the queue when it is empty, so messages keep their order
+  if (empty() && mqtt.connected()) {
+    if (mqtt.publish(topic, payload, length)) {
+      sent_++;
+      return true;
+    }
+    failed_++;
+  }
+  return enqueue(topic, payload, length);
+}
+
+void Outbox::loop(PubSubClient& mqtt)
+{
+  if (empty() || !mqtt.connected()) {
+    return;
+  }
+
+  unsigned long now = millis();
+  if (now - lastDrain_ < drainIntervalMs_) {
+    return;
+  }
+  lastDrain_ = now;
+
+  if (spillRead_ < spillSize_) {
+    size_t recordSize;
+    if (peekSpill(recordSize) && send(mqtt)) {
+      spillRead_ += recordSize;
+      if (spillRead_ >= spillSize_) {
+        LittleFS.remove(spillPath_);
+        spillRead_ = 0;
+        spillSize_ = 0;
+        spillPaused_ = false;
+      }
+    }
+  }
+  else if (peekRam() && send(mqtt)) {
+    popRam();
+  }
+
+  if (empty()) {
+    LOG_INFO("Outbox: queued messages delivered");
+  }
+}
+
+bool Outbox::send(PubSubClient& mqtt)
+{
+  if (!mqtt.publish(topic_, payload_, payloadLength_)) {
+    failed_++;
+    return false;
+  }
+  sent_++;
+  return true;
+}
+
+bool Outbox::enqueue(const char* topic, const uint8_t* payload, size_t length)
+{
+  size_t topicLength = strlen(topic);
+  if (topicLength > MAX_TOPIC || length > MAX_PAYLOAD) {
+    LOG_WARN("Outbox: message for %s too large to queue", topic);
+    dropped_++;
+    return false;
+  }
+
+  // Make room: move the oldest records to flash, or drop them
+  size_t recordSize = HEADER_SIZE + topicLength + length;
+  bool droppedOldest = false;
+  while (RAM_CAPACITY - used_ < recordSize) {
+    if (spillPath_ != nullptr && spillOldest()) {
+      continue;
+    }
+    popRam();
+    dropped_++;
+    droppedOldest = true;
+  }
+  if (droppedOldest) {
+    LOG_WARN("Outbox full, dropped oldest messages (%lu total)", (unsigned long)dropped_);
+  }
+
+  uint8_t header[HEADER_SIZE] = {
+    (uint8_t)topicLength, (uint8_t)(length & 0xFF), (uint8_t)(length >> 8)
+  };
+  size_t tail = head_ + used_;
+  ringWrite(tail, header, HEADER_SIZE);
+  ringWrite(tail + HEADER_SIZE, topic, topicLength);
+  ringWrite(tail + HEADER_SIZE + topicLength, payload, length);
+  used_ += recordSize;
+  ramCount_++;
+  return true;
+}
+
+bool Outbox::spillOldest()
+{
+  if (!peekRam()) {
+    return false;
+  }
+
+  size_t topicLength = strlen(topic_);
+  size_t recordSize = HEADER_SIZE + topicLength + payloadLength_;
+  if (spillPaused_ || spillSize_ + recordSize > spillLimit_) {
+    return false;
+  }
+
+  File file = LittleFS.open(spillPath_, "a");
+  if (!file) {
+    return false;
+  }
+  uint8_t header[HEADER_SIZE] = {
+    (uint8_t)topicLength, (uint8_t)(payloadLength_ & 0xFF), (uint8_t)(payloadLength_ >> 8)
+  };
+  bool ok = file.write(header, HEADER_SIZE) == HEADER_SIZE
+         && file.write((const uint8_t*)topic_, topicLength) == topicLength
+         && file.write(payload_, payloadLength_) == payloadLength_;
+  file.close();
+  if (!ok) {
+    // A partial record now follows the last good one: stop appending until
+    // the good part has been drained and the file removed
+    LOG_WARN("Outbox: write to %s failed, spilling paused", spillPath_);
+    spillPaused_ = true;
+    return false;
+  }
+
+  spillSize_ += recordSize;
+  popRam();
+  return true;
+}
+
+bool Outbox::peekRam()
+{
+  if (ramCount_ == 0) {
+    return false;
+  }
+  uint8_t header[HEADER_SIZE];
+  ringRead(head_, header, HEADER_SIZE);
+  size_t topicLength = header[0];
+  payloadLength_ = header[1] | (header[2] << 8);
+  ringRead(head_ + HEADER_SIZE, topic_, topicLength);
+  topic_[topicLength] = '\0';
+  ringRead(head_ + HEADER_SIZE + topicLength, payload_, payloadLength_);
+  return true;
+}
+
+void Outbox::popRam()
+{
+  if (ramCount_ == 0) {
+    return;
+  }
+  uint8_t header[HEADER_SIZE];
+  ringRead(head_, header, HEADER_SIZE);
+  size_t recordSize = HEADER_SIZE + header[0] + (header[1] | (header[2] << 8));
+  head_ = (head_ + recordSize) % RAM_CAPACITY;
+  used_ -= recordSize;
+  ramCount_--;
+}
+
+bool Outbox::peekSpill(size_t& recordSize)
+{
+  File file = LittleFS.open(spillPath_, "r");
+  bool ok = file && file.seek(spillRead_);
+
+  uint8_t header[HEADER_SIZE];
+  size_t topicLength = 0;
+  if (ok) {
+    ok = file.read(header, HEADER_SIZE) == HEADER_SIZE;
+    topicLength = header[0];
+    payloadLength_ = header[1] | (header[2] << 8);
+  }
+  ok = ok && topicLength <= MAX_TOPIC && payloadLength_ <= MAX_PAYLOAD
+          && file.read((uint8_t*)topic_, topicLength) == topicLength
+          && file.read(payload_, payloadLength_) == payloadLength_;
+  if (file) {
+    file.close();
+  }
+
+  if (!ok) {
+    // Unreadable spill file: give up on it rather than stalling the queue
+    LOG_ERROR("Outbox: spill file %s is corrupt, discarding it", spillPath_);
+    LittleFS.remove(spillPath_);
+    spillRead_ = 0;
+    spillSize_ = 0;
+    spillPaused_ = false;
+    return false;
+  }
+
+  topic_[topicLength] = '\0';
+  recordSize = HEADER_SIZE + topicLength + payloadLength_;
+  return true;
+}
+
+void Outbox::ringWrite(size_t offset, const void* data, size_t length)
+{
+  const uint8_t* src = static_cast<const uint8_t*>(data);
+  offset %= RAM_CAPACITY;
+  size_t first = length < RAM_CAPACITY - offset ? length : RAM_CAPACITY - offset;
+  memcpy(ring_ + offset, src, first);
+  memcpy(ring_, src + first, length - first);
+}
+
+void Outbox::ringRead(size_t offset, void* data, size_t length) const
+{
+  uint8_t* dst = static_cast<uint8_t*>(data);
+  offset %= RAM_CAPACITY;
+  size_t first = length < RAM_CAPACITY - offset ? length : RAM_CAPACITY - offset;
+  memcpy(dst, ring_ + offset, first);
+  memcpy(dst + first, ring_, length - first);
+}
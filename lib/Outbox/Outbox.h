@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+/**
+ * Store-and-forward queue for outgoing MQTT messages.
+ *
+ * publish() sends straight away while the session is up and nothing is
+ * queued; otherwise (or if the send fails) the encoded message is kept in
+ * a RAM ring, so timestamps are the ones taken when the data was produced.
+ * loop() drains the queue in order, one message per drainIntervalMs, once
+ * the broker is reachable again.
+ *
+ * With beginSpill() the oldest messages are moved to a LittleFS file
+ * instead of being overwritten when the ring fills up. The file is drained
+ * first (it always holds the oldest data) and survives a reboot; a reset
+ * during draining may resend a few messages. Once the file reaches its
+ * limit too, the oldest messages still in RAM are dropped.
+ */
+class Outbox {
+public:
+  static const size_t RAM_CAPACITY = 16384;  // bytes, including record headers
+  static const size_t MAX_TOPIC = 64;
+  static const size_t MAX_PAYLOAD = 2048;
+
+  explicit Outbox(unsigned long drainIntervalMs);
+
+  // Enables spilling to path on LittleFS, up to limit bytes; returns false
+  // (RAM only) if the filesystem cannot be mounted
+  bool beginSpill(const char* path, size_t limit);
+
+  // Sends or queues one message; returns false only if it had to be dropped
+  bool publish(PubSubClient& mqtt, const char* topic, const uint8_t* payload, size_t length);
+
+  // Drains queued messages while mqtt is connected (call from loop())
+  void loop(PubSubClient& mqtt);
+
+  bool empty() const { return ramCount_ == 0 && spillRead_ >= spillSize_; }
+  size_t queued() const { return ramCount_; }  // messages held in RAM
+  uint32_t dropped() const { return dropped_; }
+  uint32_t sent() const { return sent_; }      // successful publishes
+  uint32_t failed() const { return failed_; }  // publish attempts that failed
+
+private:
+  static const size_t HEADER_SIZE = 3;  // topic length (u8), payload length (u16)
+
+  bool send(PubSubClient& mqtt);  // publishes the record in topic_/payload_
+  bool enqueue(const char* topic, const uint8_t* payload, size_t length);
+  bool spillOldest();
+  bool peekRam();
+  void popRam();
+  bool peekSpill(size_t& recordSize);
+  void ringWrite(size_t offset, const void* data, size_t length);
+  void ringRead(size_t offset, void* data, size_t length) const;
+
+  uint8_t ring_[RAM_CAPACITY];
+  size_t head_;  // offset of the oldest record
+  size_t used_;
+  size_t ramCount_;
+
+  const char* spillPath_;
+  size_t spillLimit_;
+  size_t spillRead_;
+  size_t spillSize_;
+  bool spillPaused_;
+
+  unsigned long drainIntervalMs_;
+  unsigned long lastDrain_;
+  uint32_t dropped_;
+  uint32_t sent_;
+  uint32_t failed_;
+
+  // The record being drained, made contiguous for PubSubClient
+  char topic_[MAX_TOPIC + 1];
+  uint8_t payload_[MAX_PAYLOAD];
+  size_t payloadLength_;
+};
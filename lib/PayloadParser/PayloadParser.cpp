@@ -0,0 +1,236 @@
+#include "PayloadParser.h"
+
+#include <string.h>
+
+bool tokenEquals(const JsonToken& token, const char* text)
+{
+  size_t n = strlen(text);
+  return token.len == n && memcmp(token.ptr, text, n) == 0;
+}
+
+FlatJsonReader::FlatJsonReader(const uint8_t* data, size_t length)
+  : pos_(reinterpret_cast<const char*>(data)),
+    end_(reinterpret_cast<const char*>(data) + length),
+    started_(false),
+    done_(false),
+    failed_(false)
+{
+}
+
+bool FlatJsonReader::next(JsonToken& key, JsonToken& value)
+{
+  if (done_ || failed_) {
+    return false;
+  }
+
+  skipSpace();
+  if (!started_) {
+    if (pos_ == end_ || *pos_ != '{') {
+      return fail();
+    }
+    pos_++;
+    started_ = true;
+    skipSpace();
+    if (pos_ != end_ && *pos_ == '}') {
+      done_ = true;
+      return false;
+    }
+  }
+  else {
+    if (pos_ == end_) {
+      return fail();
+    }
+    if (*pos_ == '}') {
+      done_ = true;
+      return false;
+    }
+    if (*pos_ != ',') {
+      return fail();
+    }
+    pos_++;
+    skipSpace();
+  }
+
+  if (!readString(key)) {
+    return fail();
+  }
+  skipSpace();
+  if (pos_ == end_ || *pos_ != ':') {
+    return fail();
+  }
+  pos_++;
+  skipSpace();
+  if (!readValue(value)) {
+    return fail();
+  }
+  return true;
+}
+
+void FlatJsonReader::skipSpace()
+{
+  while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\r' || *pos_ == '\n')) {
+    pos_++;
+  }
+}
+
+bool FlatJsonReader::readString(JsonToken& out)
+{
+  if (pos_ == end_ || *pos_ != '"') {
+    return false;
+  }
+  const char* start = ++pos_;
+  while (pos_ != end_) {
+    if (*pos_ == '\\') {
+      if (++pos_ == end_) {
+        return false;
+      }
+    }
+    else if (*pos_ == '"') {
+      out.ptr = start;
+      out.len = pos_ - start;
+      out.isString = true;
+      pos_++;
+      return true;
+    }
+    pos_++;
+  }
+  return false;
+}
+
+bool FlatJsonReader::readValue(JsonToken& out)
+{
+  if (pos_ == end_) {
+    return false;
+  }
+  if (*pos_ == '"') {
+    return readString(out);
+  }
+
+  const char* start = pos_;
+  if (*pos_ == '{' || *pos_ == '[') {
+    // Nested container: skip it as one raw token
+    int depth = 0;
+    while (pos_ != end_) {
+      char c = *pos_;
+      if (c == '"') {
+        JsonToken ignored;
+        if (!readString(ignored)) {
+          return false;
+        }
+        continue;
+      }
+      if (c == '{' || c == '[') {
+        depth++;
+      }
+      else if (c == '}' || c == ']') {
+        if (--depth == 0) {
+          pos_++;
+          out.ptr = start;
+          out.len = pos_ - start;
+          out.isString = false;
+          return true;
+        }
+      }
+      pos_++;
+    }
+    return false;
+  }
+
+  // Number, true, false or null
+  while (pos_ != end_ && strchr(",}] \t\r\n", *pos_) == nullptr) {
+    pos_++;
+  }
+  out.ptr = start;
+  out.len = pos_ - start;
+  out.isString = false;
+  return out.len > 0;
+}
+
+bool FlatJsonReader::fail()
+{
+  failed_ = true;
+  return false;
+}
+
+namespace {
+// The first top-level member named key; reads on to the closing brace so a
+// payload that is malformed after the match is still rejected
+bool findMember(const uint8_t* payload, size_t length, const char* key, JsonToken& value)
+{
+  FlatJsonReader reader(payload, length);
+  JsonToken k;
+  JsonToken v;
+  bool found = false;
+  while (reader.next(k, v)) {
+    if (!found && tokenEquals(k, key)) {
+      value = v;
+      found = true;
+    }
+  }
+  return found && !reader.failed();
+}
+}
+
+bool jsonFindString(const uint8_t* payload, size_t length, const char* key, JsonToken& value)
+{
+  JsonToken v;
+  if (!findMember(payload, length, key, v) || !v.isString) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+bool tokenToUint(const JsonToken& token, uint32_t& value)
+{
+  if (token.isString || token.len == 0) {
+    return false;
+  }
+  uint64_t n = 0;
+  for (size_t i = 0; i < token.len; i++) {
+    if (token.ptr[i] < '0' || token.ptr[i] > '9') {
+      return false;
+    }
+    n = n * 10 + (token.ptr[i] - '0');
+    if (n > UINT32_MAX) {
+      return false;
+    }
+  }
+  value = (uint32_t)n;
+  return true;
+}
+
+size_t tokenCopy(const JsonToken& token, char* out, size_t size)
+{
+  if (size == 0) {
+    return 0;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < token.len && n + 1 < size; i++) {
+    char c = token.ptr[i];
+    if (token.isString && c == '\\' && i + 1 < token.len) {
+      c = token.ptr[++i];
+      switch (c) {
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'n': c = '\n'; break;
+        case 'r': c = '\r'; break;
+        case 't': c = '\t'; break;
+        case 'u':
+          c = '?';
+          i = i + 4 < token.len ? i + 4 : token.len - 1;  // skip the hex digits
+          break;
+        default: break;  // \" \\ \/
+      }
+    }
+    out[n++] = c;
+  }
+  out[n] = '\0';
+  return n;
+}
+
+bool jsonFindUint(const uint8_t* payload, size_t length, const char* key, uint32_t& value)
+{
+  JsonToken v;
+  return findMember(payload, length, key, v) && tokenToUint(v, value);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * In-place reader for small flat JSON objects such as {"state":"ON"}.
+ *
+ * Works directly on the MQTT payload buffer: no copies, no heap, no
+ * document. Keys and values are returned as (pointer, length) views into
+ * the payload. String views keep their escape sequences; nested objects and
+ * arrays are returned as one raw token and skipped.
+ */
+struct JsonToken {
+  const char* ptr;
+  size_t len;
+  bool isString;
+};
+
+// true if token is exactly the C string text
+bool tokenEquals(const JsonToken& token, const char* text);
+
+// Converts a plain non-negative integer token; false for strings, signs,
+// fractions or values beyond uint32
+bool tokenToUint(const JsonToken& token, uint32_t& value);
+
+// Copies a token into out, NUL-terminated and truncated to size - 1 chars,
+// resolving escapes (\uXXXX becomes '?'); returns the copied length
+size_t tokenCopy(const JsonToken& token, char* out, size_t size);
+
+class FlatJsonReader {
+public:
+  FlatJsonReader(const uint8_t* data, size_t length);
+
+  // Advances to the next member; returns false at the end or on error
+  bool next(JsonToken& key, JsonToken& value);
+
+  // true if parsing stopped on malformed input
+  bool failed() const { return failed_; }
+
+private:
+  void skipSpace();
+  bool readString(JsonToken& out);
+  bool readValue(JsonToken& out);
+  bool fail();
+
+  const char* pos_;
+  const char* end_;
+  bool started_;
+  bool done_;
+  bool failed_;
+};
+
+// Looks up the first top-level member named key as a string; returns false
+// if it is missing or not a string, or if the payload is malformed anywhere
+// up to its closing brace (the whole object is read, not just up to key)
+bool jsonFindString(const uint8_t* payload, size_t length, const char* key, JsonToken& value);
+
+// The same for an unsigned integer member; also false for a value that is
+// not a plain non-negative integer or is out of range (value is then untouched)
+bool jsonFindUint(const uint8_t* payload, size_t length, const char* key, uint32_t& value);
@@ -0,0 +1,130 @@
+#include "PcfLcd.h"
+
+namespace {
+const uint8_t PIN_RS = 0x01;
+const uint8_t PIN_EN = 0x04;
+const uint8_t PIN_BACKLIGHT = 0x08;
+
+const uint8_t CMD_CLEAR = 0x01;
+const uint8_t CMD_ENTRY_MODE = 0x06;    // increment, no shift
+const uint8_t CMD_DISPLAY_ON = 0x0C;    // display on, cursor and blink off
+const uint8_t CMD_FUNCTION_SET = 0x28;  // 4-bit bus, 2 lines, 5x8 font
+const uint8_t CMD_SET_DDRAM = 0x80;
+
+const uint8_t ROW_OFFSETS[] = { 0x00, 0x40, 0x14, 0x54 };
+}
+
+PcfLcd::PcfLcd(uint8_t address, uint32_t clockHz)
+  : address_(address),
+    clockHz_(clockHz),
+    rows_(2),
+    backlight_(PIN_BACKLIGHT),
+    length_(0)
+{
+}
+
+int PcfLcd::begin(uint8_t cols, uint8_t rows)
+{
+  rows_ = rows > sizeof(ROW_OFFSETS) ? sizeof(ROW_OFFSETS) : rows;
+
+  Wire.begin();
+  Wire.setClock(clockHz_);
+  Wire.beginTransmission(address_);
+  uint8_t status = Wire.endTransmission();
+  if (status != 0) {
+    return status;
+  }
+
+  // Power-on reset sequence from the HD44780 datasheet (figure 24): three
+  // times "8-bit mode", then switch to 4-bit, with the mandated waits
+  delay(50);
+  writeNibble(0x03);
+  delayMicroseconds(4500);
+  writeNibble(0x03);
+  delayMicroseconds(4500);
+  writeNibble(0x03);
+  delayMicroseconds(150);
+  writeNibble(0x02);
+
+  queueByte(CMD_FUNCTION_SET, false);
+  queueByte(CMD_DISPLAY_ON, false);
+  queueByte(CMD_ENTRY_MODE, false);
+  send();
+  clear();
+  return 0;
+}
+
+void PcfLcd::clear()
+{
+  queueByte(CMD_CLEAR, false);
+  send();
+  delayMicroseconds(2000);  // clear takes 1.52 ms, longer than any batch
+}
+
+void PcfLcd::setCursor(uint8_t col, uint8_t row)
+{
+  if (row >= rows_) {
+    row = rows_ - 1;
+  }
+  // Queued: goes out together with the text written next
+  queueByte(CMD_SET_DDRAM | (ROW_OFFSETS[row] + col), false);
+}
+
+void PcfLcd::setBacklight(bool on)
+{
+  backlight_ = on ? PIN_BACKLIGHT : 0;
+  queueNibble(0);  // RS/EN low, just latches the backlight bit
+  send();
+}
+
+size_t PcfLcd::write(uint8_t value)
+{
+  return write(&value, 1);
+}
+
+size_t PcfLcd::write(const uint8_t* buffer, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    queueByte(buffer[i], true);
+  }
+  return send() == 0 ? size : 0;
+}
+
+void PcfLcd::queueByte(uint8_t value, bool isData)
+{
+  if (length_ + 4 > BATCH_SIZE) {
+    send();
+  }
+  uint8_t rs = isData ? PIN_RS : 0;
+  // The controller latches each nibble on the falling edge of EN
+  batch_[length_++] = (value & 0xF0) | rs | PIN_EN | backlight_;
+  batch_[length_++] = (value & 0xF0) | rs | backlight_;
+  batch_[length_++] = (value << 4) | rs | PIN_EN | backlight_;
+  batch_[length_++] = (value << 4) | rs | backlight_;
+}
+
+void PcfLcd::queueNibble(uint8_t bits)
+{
+  if (length_ + 1 > BATCH_SIZE) {
+    send();
+  }
+  batch_[length_++] = bits | backlight_;
+}
+
+uint8_t PcfLcd::send()
+{
+  if (length_ == 0) {
+    return 0;
+  }
+  Wire.beginTransmission(address_);
+  Wire.write(batch_, length_);
+  length_ = 0;
+  return Wire.endTransmission();
+}
+
+void PcfLcd::writeNibble(uint8_t nibble)
+{
+  queueNibble((nibble << 4) | PIN_EN);
+  queueNibble(nibble << 4);
+  send();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+/**
+ * Fast HD44780 driver for PCF8574 I2C backpacks (the usual "LCD1602 I2C"
+ * module), wired P0=RS, P1=RW, P2=EN, P3=backlight, P4-P7=D4-D7.
+ *
+ * Each HD44780 byte takes four expander writes (EN high/low for each
+ * nibble). Instead of one I2C transmission per write, setCursor() and the
+ * text that follows are queued and sent as a single Wire transmission on a
+ * fast-mode (400 kHz) bus. One expander byte then takes ~22 us on the
+ * wire, so a character (~90 us) outlasts the 37 us the controller needs
+ * and no delays are required inside a batch.
+ *
+ * Fits LcdFrameBuffer::flush() (setCursor() + write(buffer, size)) and the
+ * Arduino Print API.
+ */
+class PcfLcd : public Print {
+public:
+  explicit PcfLcd(uint8_t address = 0x27, uint32_t clockHz = 400000);
+
+  // Sets up the bus and initializes the display in 4-bit mode. Returns 0 on
+  // success or the Wire error if the expander does not answer.
+  int begin(uint8_t cols, uint8_t rows);
+
+  void clear();
+  void setCursor(uint8_t col, uint8_t row);
+  void setBacklight(bool on);
+
+  size_t write(uint8_t value) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+private:
+#ifdef I2C_BUFFER_LENGTH
+  static const size_t BATCH_SIZE = I2C_BUFFER_LENGTH;  // Wire's transmit buffer
+#else
+  static const size_t BATCH_SIZE = 32;
+#endif
+
+  void queueByte(uint8_t value, bool isData);
+  void queueNibble(uint8_t bits);
+  // Sends the queued expander bytes in one transmission
+  uint8_t send();
+  // Sends one nibble right away (initialization only)
+  void writeNibble(uint8_t nibble);
+
+  uint8_t address_;
+  uint32_t clockHz_;
+  uint8_t rows_;
+  uint8_t backlight_;
+  uint8_t batch_[BATCH_SIZE];
+  size_t length_;
+};
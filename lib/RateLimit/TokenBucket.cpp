@@ -0,0 +1,33 @@
+#include "TokenBucket.h"
+
+TokenBucket::TokenBucket(uint16_t burst, unsigned long refillMs)
+  : burst_(burst),
+    refillMs_(refillMs),
+    tokens_(burst),
+    refilledAt_(0),
+    rejected_(0)
+{
+}
+
+bool TokenBucket::tryTake(unsigned long now)
+{
+  unsigned long elapsed = now - refilledAt_;
+  if (elapsed >= refillMs_) {
+    unsigned long earned = elapsed / refillMs_;
+    if (earned >= (unsigned long)(burst_ - tokens_)) {
+      tokens_ = burst_;
+      refilledAt_ = now;
+    }
+    else {
+      tokens_ += earned;
+      refilledAt_ += earned * refillMs_;  // keep the fractional progress
+    }
+  }
+
+  if (tokens_ == 0) {
+    rejected_++;
+    return false;
+  }
+  tokens_--;
+  return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Token-bucket rate limiter.
+ *
+ * Holds up to burst tokens and regains one every refillMs. Each accepted
+ * event takes a token; with none left the event is rejected, so a source
+ * can send burst events back to back and refillMs apart after that.
+ */
+class TokenBucket {
+public:
+  TokenBucket(uint16_t burst, unsigned long refillMs);
+
+  // Takes a token if one is available; counts a rejection otherwise
+  bool tryTake(unsigned long now);
+
+  uint32_t rejected() const { return rejected_; }
+
+private:
+  uint16_t burst_;
+  unsigned long refillMs_;
+  uint16_t tokens_;
+  unsigned long refilledAt_;
+  uint32_t rejected_;
+};
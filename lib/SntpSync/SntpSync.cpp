@@ -0,0 +1,40 @@
+#include "SntpSync.h"
+
+#include <Arduino.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+namespace {
+bool started = false;
+volatile bool syncPending = false;
+
+// Runs in the lwIP task: only flag it, the clock is read in sntpTakeSync()
+void onTimeSync(struct timeval* tv)
+{
+  syncPending = true;
+}
+}
+
+void sntpBegin(const char* server)
+{
+  if (started) {
+    return;
+  }
+  started = true;
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTime(0, 0, server);
+}
+
+bool sntpTakeSync(int64_t& epochMs, unsigned long& atMs)
+{
+  if (!syncPending) {
+    return false;
+  }
+  syncPending = false;
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  atMs = millis();
+  epochMs = (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  return true;
+}
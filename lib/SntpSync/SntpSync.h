@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * SNTP time source for CalendarClock.
+ *
+ * sntpBegin() starts the lwIP SNTP client in UTC (it re-syncs by itself
+ * every hour) and may be called on every (re)connect. Each completed sync
+ * is reported once by sntpTakeSync(), for whoever owns the clock to feed
+ * into CalendarClock::sync().
+ */
+void sntpBegin(const char* server = "pool.ntp.org");
+
+// true once per completed sync, with the UTC time (ms since the epoch)
+// and the millis() value it was taken at
+bool sntpTakeSync(int64_t& epochMs, unsigned long& atMs);
@@ -0,0 +1,26 @@
+#include "DeadbandFilter.h"
+
+DeadbandFilter::DeadbandFilter(uint16_t deadband, unsigned long heartbeatMs)
+  : deadband_(deadband),
+    heartbeatMs_(heartbeatMs),
+    hasReported_(false),
+    lastValue_(0),
+    lastAt_(0),
+    suppressed_(0)
+{
+}
+
+bool DeadbandFilter::update(uint16_t value, unsigned long now)
+{
+  uint16_t delta = value > lastValue_ ? value - lastValue_ : lastValue_ - value;
+
+  if (hasReported_ && delta < deadband_ && now - lastAt_ < heartbeatMs_) {
+    suppressed_++;
+    return false;
+  }
+
+  hasReported_ = true;
+  lastValue_ = value;
+  lastAt_ = now;
+  return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Report-by-exception policy for sampled values.
+ *
+ * A value is reported when it differs from the last reported value by at
+ * least the deadband, or when nothing has been reported for heartbeatMs
+ * (so subscribers can tell a stable sensor from a dead node). The first
+ * value is always reported.
+ */
+class DeadbandFilter {
+public:
+  DeadbandFilter(uint16_t deadband, unsigned long heartbeatMs);
+
+  // Returns true if value should be published; it then becomes the
+  // reference for the deadband
+  bool update(uint16_t value, unsigned long now);
+
+  uint32_t suppressed() const { return suppressed_; }
+
+private:
+  uint16_t deadband_;
+  unsigned long heartbeatMs_;
+  bool hasReported_;
+  uint16_t lastValue_;
+  unsigned long lastAt_;
+  uint32_t suppressed_;
+};
@@ -0,0 +1,132 @@
+#include "MessageBuilder.h"
+
+#include <string.h>
+#include "TelemetryCodec.h"
+
+ArenaAllocator::ArenaAllocator(uint8_t* buffer, size_t size)
+  : buffer_(buffer),
+    size_(size),
+    used_(0),
+    last_(0),
+    live_(0),
+    peak_(0),
+    failures_(0)
+{
+}
+
+void* ArenaAllocator::allocate(size_t size)
+{
+  size_t total = blockSize(size);
+  if (total > size_ - used_) {
+    failures_++;
+    return nullptr;
+  }
+
+  Header* block = reinterpret_cast<Header*>(buffer_ + used_);
+  block->size = size;
+  last_ = used_;
+  used_ += total;
+  live_++;
+  if (used_ > peak_) {
+    peak_ = used_;
+  }
+  return block + 1;
+}
+
+void ArenaAllocator::deallocate(void* ptr)
+{
+  if (ptr == nullptr) {
+    return;
+  }
+  if (--live_ == 0) {
+    used_ = 0;
+    last_ = 0;
+  }
+  else if (isLast(ptr)) {
+    used_ = last_;  // only the newest block can be given back early
+  }
+}
+
+void* ArenaAllocator::reallocate(void* ptr, size_t newSize)
+{
+  if (ptr == nullptr) {
+    return allocate(newSize);
+  }
+
+  // The newest block grows or shrinks in place
+  if (isLast(ptr)) {
+    size_t total = blockSize(newSize);
+    if (total > size_ - last_) {
+      failures_++;
+      return nullptr;
+    }
+    header(ptr)->size = newSize;
+    used_ = last_ + total;
+    if (used_ > peak_) {
+      peak_ = used_;
+    }
+    return ptr;
+  }
+
+  size_t oldSize = header(ptr)->size;
+  void* moved = allocate(newSize);
+  if (moved == nullptr) {
+    return nullptr;  // the old block stays valid, like realloc()
+  }
+  memcpy(moved, ptr, oldSize < newSize ? oldSize : newSize);
+  deallocate(ptr);
+  return moved;
+}
+
+size_t ArenaAllocator::blockSize(size_t size)
+{
+  const size_t align = alignof(max_align_t);
+  return (sizeof(Header) + size + align - 1) & ~(align - 1);
+}
+
+ArenaAllocator::Header* ArenaAllocator::header(void* ptr) const
+{
+  return static_cast<Header*>(ptr) - 1;
+}
+
+bool ArenaAllocator::isLast(void* ptr) const
+{
+  return reinterpret_cast<uint8_t*>(header(ptr)) == buffer_ + last_ && used_ > last_;
+}
+
+MessageBuilder::MessageBuilder(uint8_t* arena, size_t size)
+  : allocator_(arena, size),
+    doc_(&allocator_)
+{
+}
+
+JsonDocument& MessageBuilder::reset()
+{
+  doc_.clear();
+  return doc_;
+}
+
+size_t MessageBuilder::serialize(uint8_t* out, size_t size) const
+{
+  if (doc_.overflowed()) {
+    return 0;
+  }
+#if TELEMETRY_ENCODING == TELEMETRY_ENCODING_MSGPACK
+  if (measureMsgPack(doc_) > size) {
+    return 0;
+  }
+  return serializeMsgPack(doc_, out, size);
+#else
+  if (measureJson(doc_) >= size) {
+    return 0;
+  }
+  return serializeJson(doc_, reinterpret_cast<char*>(out), size);
+#endif
+}
+
+MessageBuilder& telemetryBuilder()
+{
+  alignas(max_align_t) static uint8_t arena[TELEMETRY_ARENA_SIZE];
+  static MessageBuilder builder(arena, sizeof(arena));
+  return builder;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ArduinoJson.h>
+
+/**
+ * Heap-free construction of JSON/MessagePack telemetry messages.
+ *
+ * ArduinoJson 7 documents allocate their memory pools from the heap. Here
+ * the pools come from a fixed arena instead, and one document is reused for
+ * every message: reset() clears it, which hands all of its memory back to
+ * the arena. Steady-state publishing therefore never calls malloc().
+ *
+ * The shared builder is not thread-safe; only the network path uses it.
+ */
+
+// Size of the shared arena; must hold the largest batch document
+#ifndef TELEMETRY_ARENA_SIZE
+#define TELEMETRY_ARENA_SIZE 8192
+#endif
+
+// Bump allocator over a caller-provided buffer. Freed blocks are reclaimed
+// when they are the most recent allocation or once every block is free,
+// which is exactly how a document that is cleared per message behaves.
+class ArenaAllocator : public ArduinoJson::Allocator {
+public:
+  ArenaAllocator(uint8_t* buffer, size_t size);
+
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t newSize) override;
+
+  size_t used() const { return used_; }
+  size_t peak() const { return peak_; }
+  uint32_t failures() const { return failures_; }  // allocations refused
+
+private:
+  struct Header {
+    size_t size;
+  };
+  static size_t blockSize(size_t size);
+  Header* header(void* ptr) const;
+  bool isLast(void* ptr) const;
+
+  uint8_t* buffer_;
+  size_t size_;
+  size_t used_;
+  size_t last_;  // offset of the most recent block
+  size_t live_;  // blocks not yet freed
+  size_t peak_;
+  uint32_t failures_;
+};
+
+class MessageBuilder {
+public:
+  MessageBuilder(uint8_t* arena, size_t size);
+
+  // Clears the previous message and returns the empty document
+  JsonDocument& reset();
+
+  // Serializes the document with the build's TELEMETRY_ENCODING; returns
+  // the length, or 0 if the document overflowed the arena or did not fit
+  size_t serialize(uint8_t* out, size_t size) const;
+
+  const ArenaAllocator& arena() const { return allocator_; }
+
+private:
+  ArenaAllocator allocator_;
+  JsonDocument doc_;
+};
+
+// Builder shared by TelemetryBatch and the event encoders
+MessageBuilder& telemetryBuilder();
@@ -0,0 +1,94 @@
+#include "TelemetryBatch.h"
+
+#include "MessageBuilder.h"
+#include "TelemetryCodec.h"
+
+TelemetryBatch::TelemetryBatch(size_t maxSamples, unsigned long maxAgeMs)
+  : head_(0),
+    count_(0),
+    maxSamples_(maxSamples > CAPACITY ? CAPACITY : maxSamples),
+    maxAgeMs_(maxAgeMs),
+    nextSeq_(0)
+{
+}
+
+bool TelemetryBatch::push(const LightSample& sample, unsigned long now)
+{
+  if (count_ == CAPACITY) {
+    samples_[head_] = sample;
+    samples_[head_].seq = nextSeq_++;
+    queuedAt_[head_] = now;
+    head_ = (head_ + 1) % CAPACITY;
+    return false;
+  }
+
+  size_t i = (head_ + count_) % CAPACITY;
+  samples_[i] = sample;
+  samples_[i].seq = nextSeq_++;
+  queuedAt_[i] = now;
+  count_++;
+  return true;
+}
+
+bool TelemetryBatch::due(unsigned long now) const
+{
+  if (count_ == 0) {
+    return false;
+  }
+  // The oldest sample still queued, after pop() or an overwrite too
+  return count_ >= maxSamples_ || now - queuedAt_[head_] >= maxAgeMs_;
+}
+
+void TelemetryBatch::pop(size_t n)
+{
+  if (n > count_) {
+    n = count_;
+  }
+  head_ = (head_ + n) % CAPACITY;
+  count_ -= n;
+}
+
+size_t TelemetryBatch::encode(const Timebase& timebase, uint8_t* out, size_t size) const
+{
+#if TELEMETRY_ENCODING == TELEMETRY_ENCODING_PACKED
+  return encodePacked(timebase, out, size);
+#else
+  size_t n = batchSize();
+  MessageBuilder& builder = telemetryBuilder();
+  JsonArray samples = builder.reset().to<JsonArray>();
+  for (size_t i = 0; i < n; i++) {
+    JsonObject entry = samples.add<JsonObject>();
+    entry["seq"] = at(i).seq;
+    entry["light"] = at(i).light;
+    entry["min"] = at(i).min;
+    entry["max"] = at(i).max;
+    entry["ema"] = at(i).ema;
+    entry["timestamp"] = timebase.toEpoch(at(i).timestamp);
+  }
+  return builder.serialize(out, size);
+#endif
+}
+
+size_t TelemetryBatch::encodePacked(const Timebase& timebase, uint8_t* out, size_t size) const
+{
+  size_t n = batchSize();
+  if (n == 0 || size < 15 + n * 12) {
+    return 0;
+  }
+  // Samples in a batch are consecutive, so one seq/timestamp header covers
+  // them and each record only carries its offset from the first
+  uint8_t* p = out;
+  *p++ = PACKED_MAGIC;
+  *p++ = PACKED_LIGHT_BATCH;
+  *p++ = (uint8_t)n;
+  p = putU32(p, at(0).seq);
+  p = putU64(p, (uint64_t)timebase.toEpoch(at(0).timestamp));
+  for (size_t i = 0; i < n; i++) {
+    p = putU16(p, at(i).light);
+    p = putU16(p, at(i).min);
+    p = putU16(p, at(i).max);
+    p = putU16(p, at(i).ema);
+    p = putU32(p, at(i).timestamp - at(0).timestamp);
+  }
+  return p - out;
+}
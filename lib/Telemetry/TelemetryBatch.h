@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TelemetryCodec.h"
+
+// One published light reading: the mean of a sampling window plus its
+// min/max and the running EMA
+struct LightSample {
+  uint16_t light;
+  uint16_t min;
+  uint16_t max;
+  uint16_t ema;
+  uint32_t timestamp;  // millis() at the end of the window
+  uint32_t seq;        // assigned by TelemetryBatch::push()
+};
+
+/**
+ * Ring buffer that groups light samples into one MQTT message.
+ *
+ * A batch is due when it holds maxSamples samples or its oldest sample was
+ * queued maxAgeMs ago (the now given to push()). Samples stay queued until pop() is called after a
+ * successful publish; if publishing keeps failing the oldest samples are
+ * overwritten once the ring is full.
+ */
+class TelemetryBatch {
+public:
+  static const size_t CAPACITY = 64;
+
+  TelemetryBatch(size_t maxSamples, unsigned long maxAgeMs);
+
+  // Appends a sample queued at now, numbering it with the next sequence
+  // number; returns false if the oldest sample was overwritten
+  bool push(const LightSample& sample, unsigned long now);
+
+  // Continues the numbering at seq (for samples kept across deep sleep)
+  void setNextSeq(uint32_t seq) { nextSeq_ = seq; }
+
+  // true when the flush policy says the batch should be published
+  bool due(unsigned long now) const;
+
+  size_t size() const { return count_; }
+  const LightSample& at(size_t i) const { return samples_[(head_ + i) % CAPACITY]; }
+
+  // Number of samples the next message carries (at most maxSamples)
+  size_t batchSize() const { return count_ < maxSamples_ ? count_ : maxSamples_; }
+
+  // Removes the n oldest samples (after they were published)
+  void pop(size_t n);
+
+  // Encodes the next batchSize() samples as one message (an array of
+  // {"seq","light","min","max","ema","timestamp"} records, see
+  // TelemetryCodec.h); returns the length, or 0 if it did not fit
+  size_t encode(const Timebase& timebase, uint8_t* out, size_t size) const;
+
+  // The same batch in the packed layout, as encode() produces it in the
+  // packed build (built in every build, for the native tests)
+  size_t encodePacked(const Timebase& timebase, uint8_t* out, size_t size) const;
+
+private:
+  LightSample samples_[CAPACITY];
+  unsigned long queuedAt_[CAPACITY];  // push() time of each slot
+  size_t head_;
+  size_t count_;
+  size_t maxSamples_;
+  unsigned long maxAgeMs_;
+  uint32_t nextSeq_;
+};
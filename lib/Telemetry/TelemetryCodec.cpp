@@ -0,0 +1,34 @@
+#include "TelemetryCodec.h"
+
+#include "MessageBuilder.h"
+
+size_t encodeButtonEvent(bool pressed, uint32_t seq, uint32_t ms, const Timebase& timebase,
+                         uint8_t* out, size_t size)
+{
+  int64_t timestamp = timebase.toEpoch(ms);
+#if TELEMETRY_ENCODING == TELEMETRY_ENCODING_PACKED
+  return encodePackedButtonEvent(pressed, seq, timestamp, out, size);
+#else
+  MessageBuilder& builder = telemetryBuilder();
+  JsonDocument& doc = builder.reset();
+  doc["seq"] = seq;
+  doc["event"] = pressed ? "pressed" : "released";
+  doc["timestamp"] = timestamp;
+  return builder.serialize(out, size);
+#endif
+}
+
+size_t encodePackedButtonEvent(bool pressed, uint32_t seq, int64_t timestamp,
+                               uint8_t* out, size_t size)
+{
+  if (size < 15) {
+    return 0;
+  }
+  uint8_t* p = out;
+  *p++ = PACKED_MAGIC;
+  *p++ = PACKED_BUTTON_EVENT;
+  *p++ = pressed ? 1 : 0;
+  p = putU32(p, seq);
+  p = putU64(p, (uint64_t)timestamp);
+  return p - out;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Wire encoding for sensor and button telemetry, selected at build time:
+ *
+ *   -DTELEMETRY_ENCODING=TELEMETRY_ENCODING_JSON     (default) text JSON
+ *   -DTELEMETRY_ENCODING=TELEMETRY_ENCODING_MSGPACK  same schema as MessagePack
+ *   -DTELEMETRY_ENCODING=TELEMETRY_ENCODING_PACKED   fixed little-endian records
+ *
+ * Every record carries a sequence number (per stream, restarts at 0 on
+ * boot) and a timestamp in UTC milliseconds since the epoch. Until the
+ * node's clock has synced, timestamps are milliseconds since boot instead;
+ * receivers tell them apart by magnitude (epoch ms are > 1e11).
+ *
+ * Packed records start with PACKED_MAGIC (a byte MessagePack never uses and
+ * JSON cannot start with) followed by a record type:
+ *
+ *   light batch:  C1 03 <count:u8> <firstSeq:u32> <firstTimestamp:u64>
+ *                 count x (<light:u16> <min:u16> <max:u16> <ema:u16> <offsetMs:u32>)
+ *   button event: C1 04 <pressed:u8> <seq:u32> <timestamp:u64>
+ *
+ * (Types 01/02 were the earlier layouts with u32 uptime timestamps and no
+ * sequence numbers.) client/app.py tells the three encodings apart by the
+ * first byte.
+ */
+#define TELEMETRY_ENCODING_JSON    0
+#define TELEMETRY_ENCODING_MSGPACK 1
+#define TELEMETRY_ENCODING_PACKED  2
+
+#ifndef TELEMETRY_ENCODING
+#define TELEMETRY_ENCODING TELEMETRY_ENCODING_JSON
+#endif
+
+const uint8_t PACKED_MAGIC = 0xC1;
+const uint8_t PACKED_LIGHT_BATCH = 0x03;
+const uint8_t PACKED_BUTTON_EVENT = 0x04;
+
+/**
+ * Maps millis() stamps to UTC epoch milliseconds, as a snapshot of the
+ * wall clock (CalendarClock) taken when a message is encoded: epochMs was
+ * the time at millis() == atMs. Converting at encode time means readings
+ * taken before the first clock sync still get a real time. With valid
+ * false the stamps pass through as milliseconds since boot.
+ */
+struct Timebase {
+  bool valid;
+  int64_t epochMs;
+  uint32_t atMs;
+
+  int64_t toEpoch(uint32_t ms) const
+  {
+    return valid ? epochMs + (int32_t)(ms - atMs) : (int64_t)ms;
+  }
+};
+
+// Little-endian helpers for packed records
+inline uint8_t* putU16(uint8_t* out, uint16_t v)
+{
+  out[0] = v & 0xFF;
+  out[1] = v >> 8;
+  return out + 2;
+}
+
+inline uint8_t* putU32(uint8_t* out, uint32_t v)
+{
+  out[0] = v & 0xFF;
+  out[1] = (v >> 8) & 0xFF;
+  out[2] = (v >> 16) & 0xFF;
+  out[3] = v >> 24;
+  return out + 4;
+}
+
+inline uint8_t* putU64(uint8_t* out, uint64_t v)
+{
+  return putU32(putU32(out, (uint32_t)v), (uint32_t)(v >> 32));
+}
+
+// Encodes {"seq":...,"event":"pressed"|"released","timestamp":...} for an
+// edge at millis() == ms; returns the payload length, or 0 if it did not fit
+size_t encodeButtonEvent(bool pressed, uint32_t seq, uint32_t ms, const Timebase& timebase,
+                         uint8_t* out, size_t size);
+
+// The packed button event layout, used by encodeButtonEvent() in the packed
+// build. Built whatever TELEMETRY_ENCODING is, so the native tests can
+// check it (unused, it is dropped at link time).
+size_t encodePackedButtonEvent(bool pressed, uint32_t seq, int64_t timestamp,
+                               uint8_t* out, size_t size);
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Allocation-free MQTT topic -> handler dispatch.
+ *
+ * Topics are hashed with FNV-1a. topicHash() is constexpr, so route tables
+ * declared as constexpr TopicRoute arrays are hashed by the compiler; at
+ * runtime the incoming topic is hashed once and looked up in a fixed-size
+ * open-addressing table (a strcmp() on the hit guards against collisions).
+ *
+ * For single-level wildcard subscriptions ("prefix/+"), topicChild() strips
+ * the prefix so a dispatcher keyed on the last segment can route the rest.
+ */
+
+// Handler for one topic. arg is the value given at registration (e.g. a pin).
+typedef void (*TopicHandler)(uint8_t* payload, unsigned int length, int arg);
+
+// FNV-1a 32-bit
+constexpr uint32_t topicHash(const char* topic, uint32_t hash = 2166136261u)
+{
+  return *topic ? topicHash(topic + 1, (hash ^ (uint8_t)*topic) * 16777619u) : hash;
+}
+
+// If topic is prefix plus exactly one more level (what a "prefix+"
+// subscription matches), returns that last segment; otherwise nullptr.
+// prefix includes the trailing '/'.
+inline const char* topicChild(const char* topic, const char* prefix)
+{
+  size_t n = strlen(prefix);
+  if (strncmp(topic, prefix, n) != 0 || topic[n] == '\0' || strchr(topic + n, '/') != nullptr) {
+    return nullptr;
+  }
+  return topic + n;
+}
+
+struct TopicRoute {
+  uint32_t hash;
+  const char* topic;
+  TopicHandler handler;
+  int arg;
+};
+
+// Capacity must be a power of two and larger than the number of routes
+template <size_t Capacity>
+class TopicDispatcher {
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                "TopicDispatcher capacity must be a power of two");
+
+public:
+  TopicDispatcher() : count_(0)
+  {
+    memset(slots_, 0, sizeof(slots_));
+  }
+
+  // Registers one route; returns false if the table is full
+  bool on(const TopicRoute& route)
+  {
+    if (count_ >= Capacity - 1) {
+      return false;
+    }
+    size_t i = route.hash & (Capacity - 1);
+    while (slots_[i].topic != nullptr) {
+      if (slots_[i].hash == route.hash && strcmp(slots_[i].topic, route.topic) == 0) {
+        slots_[i] = route;  // re-registering a topic replaces its handler
+        return true;
+      }
+      i = (i + 1) & (Capacity - 1);
+    }
+    slots_[i] = route;
+    count_++;
+    return true;
+  }
+
+  template <size_t N>
+  bool on(const TopicRoute (&routes)[N])
+  {
+    bool ok = true;
+    for (size_t i = 0; i < N; i++) {
+      ok = on(routes[i]) && ok;
+    }
+    return ok;
+  }
+
+  // Returns the route registered for topic, or nullptr
+  const TopicRoute* find(const char* topic) const
+  {
+    uint32_t hash = 2166136261u;
+    for (const char* p = topic; *p; p++) {
+      hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    size_t i = hash & (Capacity - 1);
+    while (slots_[i].topic != nullptr) {
+      if (slots_[i].hash == hash && strcmp(slots_[i].topic, topic) == 0) {
+        return &slots_[i];
+      }
+      i = (i + 1) & (Capacity - 1);
+    }
+    return nullptr;
+  }
+
+  // Calls the handler registered for topic; returns false if there is none
+  bool dispatch(const char* topic, uint8_t* payload, unsigned int length) const
+  {
+    const TopicRoute* route = find(topic);
+    if (route == nullptr) {
+      return false;
+    }
+    route->handler(payload, length, route->arg);
+    return true;
+  }
+
+  size_t size() const { return count_; }
+
+private:
+  TopicRoute slots_[Capacity];
+  size_t count_;
+};
@@ -19,51 +19,252 @@
 #include "WiFi.h"
 #include "PubSubClient.h"
 #include <ArduinoJson.h>
+#include <esp_timer.h>
+#include "ConnectionManager.h"
+#include "Log.h"
+#include "LightSampler.h"
+#include "ButtonDebouncer.h"
+#include "SpscRing.h"
+#include "DeadbandFilter.h"
+#include "TelemetryBatch.h"
+#include "TelemetryCodec.h"
+#include "Outbox.h"
+#include "Metrics.h"
+#include "CalendarTime.h"
+#include "SntpSync.h"
+#include "LowPower.h"
+#include "NodeConfig.h"
+
+#if !NODE_HAS_SENSOR || !NODE_HAS_BUTTON
+#error "lab3_ex1 needs a node profile with the light sensor and the button"
+#endif
+
+// Power mode:
+//   LAB3_POWER_ALWAYS_ON    CPU and WiFi always awake, 1 kHz light sampling
+//   LAB3_POWER_LIGHT_SLEEP  one reading per sampling period, WiFi modem sleep
+//                           and CPU light sleep in between (stays connected)
+//   LAB3_POWER_DEEP_SLEEP   deep sleep between readings; readings wait in RTC
+//                           memory and go out as one batch every few wakes,
+//                           and the button (ext0) wakes the node at once
+#define LAB3_POWER_ALWAYS_ON   0
+#define LAB3_POWER_LIGHT_SLEEP 1
+#define LAB3_POWER_DEEP_SLEEP  2
+
+#ifndef LAB3_POWER_MODE
+#define LAB3_POWER_MODE LAB3_POWER_ALWAYS_ON
+#endif
 
 // Your code here - global declarations
-const int lightSensorPin = 33; // GPIO pin for light sensor
-const int buttonPin = 25;      // GPIO pin for button
+const int lightSensorPin = NODE_PIN_LIGHT; // GPIO pin for light sensor
+const int buttonPin = NODE_PIN_BUTTON;     // GPIO pin for button (must be an RTC GPIO to wake deep sleep)
 
 // WiFi credentials
-const char* ssid = "MaxPC";
-const char* password = "polito2025";
+const char* ssid = NODE_WIFI_SSID;
+const char* password = NODE_WIFI_PASSWORD;
 
 // MQTT Broker settings
-const char* mqtt_broker = "mqtt.iotserver.uz";  // Free public MQTT broker
-const int mqtt_port = 1883;
-const char* mqtt_username = "userTTPU";  // username given in the telegram group
-const char* mqtt_password = "mqttpass";  // password given in the telegram group
-
-const char* mqtt_topic_sensor = "ttpu/iot/maqsud/sensors/light"; 
-const char* mqtt_topic_button = "ttpu/iot/maqsud/events/button";
+const char* mqtt_broker = NODE_MQTT_BROKER;
+const int mqtt_port = NODE_MQTT_PORT;
+const char* mqtt_username = NODE_MQTT_USERNAME;
+const char* mqtt_password = NODE_MQTT_PASSWORD;
+
+const char* mqtt_topic_sensor = NODE_TOPIC("sensors/light");
+const char* mqtt_topic_button = NODE_TOPIC("events/button");
+const char* mqtt_topic_metrics = NODE_TOPIC("metrics");
+
+// Sensor sampling and batching: a hardware timer samples the ADC at 1 kHz,
+// every 20 samples are decimated into one reading (50 Hz), and readings are
+// published 25 per message or once per second, whichever comes first
+const uint32_t sensorSampleRateHz = 1000;      // ADC samples per second
+const size_t sensorWindowSize = 20;            // samples per published reading
+const size_t sensorBatchSize = 25;             // readings per message
+#if LAB3_POWER_MODE == LAB3_POWER_ALWAYS_ON
+const unsigned long sensorBatchMaxAge = 1000;  // ms before a partial batch is sent
+#else
+const unsigned long sensorBatchMaxAge = 60000; // on battery: one publish a minute
+#endif
+LightSampler lightSampler;
+TelemetryBatch sensorBatch(sensorBatchSize, sensorBatchMaxAge);
+
+// Low-power modes read the sensor in one short ADC burst per sampling
+// period instead (the 1 kHz sampler would keep the CPU awake)
+const unsigned long lowPowerSampleMs = 5000;  // one reading every 5 s
+const size_t lowPowerBurstSize = 16;          // ADC reads averaged per reading
+
+// Report by exception: a reading is only published when it moves by at least
+// the deadband, or when the sensor has been silent for the heartbeat period
+const uint16_t sensorDeadband = 40;              // ADC counts (~1% of full scale)
+const unsigned long sensorHeartbeatMs = 30000;   // max silence while stable
+DeadbandFilter sensorFilter(sensorDeadband, sensorHeartbeatMs);
+
+// Button edges: the ISR timestamps every edge and queues it, loop() debounces
+const int64_t buttonDebounceUs = 50000;  // 50 ms quiet time
+SpscRing<ButtonEdge, 32> buttonEdges;
+ButtonDebouncer buttonDebouncer(buttonDebounceUs, LOW);
+
+// GPIO interrupt on buttonPin (both edges)
+void IRAM_ATTR onButtonEdge();
+uint32_t buttonSeq = 0;  // sequence number of the next button event
+
+// Wall clock for message timestamps, synced by SNTP once the network is up;
+// until then messages carry ms since boot
+CalendarClock wallClock({ 1970, 1, 1, 0, 0, 0 }, 0);
+// Snapshot of wallClock for encoding timestamps (see TelemetryCodec.h)
+Timebase telemetryTimebase();
 
 WiFiClient espClient;
 PubSubClient mqtt_client(espClient);
-
-// Function to connect to WiFi
-void connectWiFi();
-// Function to connect/reconnect to MQTT broker
-void connectMQTT();
+ConnectionManager connection(espClient, mqtt_client);
+
+// Store-and-forward: messages produced while the broker is unreachable are
+// queued (RAM first, then flash) and drained at this rate once it is back
+const unsigned long outboxDrainIntervalMs = 50;  // ~20 messages per second
+const size_t outboxSpillLimit = 64 * 1024;       // bytes on LittleFS
+Outbox outbox(outboxDrainIntervalMs);
+
+// Runtime metrics (latency histograms, counters, heap), published as JSON
+const unsigned long metricsIntervalMs = 10000;
+Metrics metrics(metricsIntervalMs);
+LatencyHistogram loopLatency;  // one loop() iteration
+LatencyHistogram mqttLatency;  // connection.loop(), i.e. mqtt_client.loop() or a connect attempt
+
+// Filters and batches one sensor reading
+void addReading(const LightWindow& window);
+// One reading from a burst of ADC reads (low-power modes)
+LightWindow readLightBurst(uint16_t& ema, bool& emaValid);
+
+// Datasheet current draw of the ESP32 module alone, in uA, used to estimate
+// the average draw from the measured awake/asleep times. Dev boards add a
+// few mA for the regulator and USB-UART; measure with a meter for real numbers.
+const uint32_t wifiActiveUa = 100000;  // radio on: connecting, receiving, sending
+const uint32_t cpuActiveUa = 30000;    // CPU running at 80 MHz, modem sleep
+const uint32_t cpuIdleUa = 20000;      // CPU idle at 80 MHz, modem sleep
+const uint32_t lightSleepUa = 2000;    // automatic light sleep incl. beacon wakes
+const uint32_t deepSleepUa = 10;       // RTC timer and RTC memory only
+
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+// loop() runs every buttonPollMs and sleeps in between; the button is
+// polled, edge interrupts are not seen while the CPU sleeps
+const unsigned long buttonPollMs = 20;
+const uint32_t lightSleepCpuMhz = 80;
+bool autoLightSleep = false;   // CPU light-sleeps when idle (else modem sleep only)
+uint64_t activeUs = 0;         // time spent running loop()
+uint64_t idleUs = 0;           // time spent sleeping between iterations
+int64_t wokeAtUs = 0;          // end of the last sleep
+LatencyHistogram publishLatency;  // wake to sensor batch published
+void pollButton();
+#endif
+
+#if LAB3_POWER_MODE == LAB3_POWER_DEEP_SLEEP
+// A wake publishes once this many readings are buffered (one message a
+// minute), or at once when it has button events
+const size_t deepSleepBatchSize = sensorBatchMaxAge / lowPowerSampleMs;
+const size_t deepSleepMaxSamples = TelemetryBatch::CAPACITY;  // ~5 min offline
+const size_t deepSleepMaxButtons = 8;
+const unsigned long deepSleepConnectTimeoutMs = 15000;
+const unsigned long deepSleepFlushMs = 100;       // let TCP send before the radio goes off
+const unsigned long buttonReleaseWaitMs = 2000;   // stay up this long for a held button
+const unsigned long sntpWaitMs = 2000;            // wait for a time sync before publishing
+const int64_t sntpResyncMs = 3600000;             // RTC clock drift: resync hourly
+
+struct RetainedButtonEvent {
+  uint8_t pressed;
+  uint32_t seq;
+  uint32_t timestamp;  // (uint32_t)systemTimeMs()
+};
+
+// Kept in RTC memory across deep sleep (zeroed on power-on). Timestamps are
+// (uint32_t)systemTimeMs(), which keeps counting while asleep.
+struct RetainedState {
+  LightSample samples[deepSleepMaxSamples];  // readings not published yet, oldest first
+  uint32_t sampleCount;
+  uint32_t nextSampleSeq;
+  uint32_t samplesDropped;
+  RetainedButtonEvent buttons[deepSleepMaxButtons];
+  uint32_t buttonCount;
+  uint32_t nextButtonSeq;
+  bool buttonHeld;
+  uint16_t ema;
+  bool emaValid;
+  bool clockSynced;
+  int64_t syncedAtMs;   // systemTimeMs() of the last SNTP sync
+  uint32_t wakes;
+  // Since the last power report: time awake with and without the radio,
+  // and time asleep
+  uint32_t radioMs;
+  uint32_t cpuMs;
+  uint32_t sleepMs;
+  uint32_t lastWakeToPublishMs;  // millis() at the first publish (boot ROM time not included)
+  uint32_t lastAwakeMs;          // millis() when the last publishing wake was done
+};
+RTC_DATA_ATTR RetainedState retained;
+int64_t bootSystemMs = 0;  // systemTimeMs() at millis() == 0 before any sync
+
+// One wake: read, buffer, publish when due, deep sleep again; never returns
+void deepSleepCycle();
+#endif
 
 /*************************
  * SETUP
  */
 void setup()
 {
+#if LAB3_POWER_MODE == LAB3_POWER_DEEP_SLEEP
+    deepSleepCycle();
+#endif
+
     Serial.begin(115200);
     delay(1000);
-    Serial.println("\n===== Lab 3 - Exercise 1 =====");
+    logBegin();
+    LOG_INFO("===== Lab 3 - Exercise 1 =====");
     // Initialize pins
     pinMode(buttonPin, INPUT);
+    buttonDebouncer = ButtonDebouncer(buttonDebounceUs, digitalRead(buttonPin));
+#if LAB3_POWER_MODE == LAB3_POWER_ALWAYS_ON
+    attachInterrupt(digitalPinToInterrupt(buttonPin), onButtonEdge, CHANGE);
 
-    // Connect to WiFi
-    connectWiFi();
+    // Start timer-driven light sensor sampling
+    if (!lightSampler.begin(lightSensorPin, sensorSampleRateHz, sensorWindowSize)) {
+        LOG_ERROR("Light sensor sampler failed to start!");
+    }
+#endif
 
     // Setup MQTT
     mqtt_client.setServer(mqtt_broker, mqtt_port);
-
-    // Connect to MQTT broker
-    connectMQTT();
+    mqtt_client.setBufferSize(2176);  // room for a full sensor batch
+
+    // Keep telemetry across broker outages (and reboots, via flash)
+    outbox.beginSpill("/outbox.bin", outboxSpillLimit);
+
+    // Metrics reported on mqtt_topic_metrics
+    metrics.addHistogram("loop_us", loopLatency);
+    metrics.addHistogram("mqtt_us", mqttLatency);
+    metrics.addCounter("published", []() { return outbox.sent(); });
+    metrics.addCounter("publish_failures", []() { return outbox.failed(); });
+    metrics.addCounter("outbox_queued", []() { return (uint32_t)outbox.queued(); });
+    metrics.addCounter("outbox_dropped", []() { return outbox.dropped(); });
+    metrics.addCounter("reconnects", []() { return connection.reconnects(); });
+    metrics.addCounter("wifi_connect_ms", []() { return (uint32_t)connection.wifiConnectMs(); });
+    metrics.addCounter("sampler_overruns", []() { return lightSampler.overruns(); });
+    metrics.addCounter("log_dropped", logDropped);
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+    metrics.addHistogram("publish_us", publishLatency);
+    metrics.addCounter("light_sleep", []() { return (uint32_t)autoLightSleep; });
+    metrics.addCounter("est_current_ua", []() {
+        return averageCurrent(activeUs / 1000, cpuActiveUa,
+                              idleUs / 1000, autoLightSleep ? lightSleepUa : cpuIdleUa);
+    });
+#endif
+    metrics.setTimebase(telemetryTimebase);
+
+    // Start WiFi + MQTT (connects in the background from loop())
+    connection.begin(ssid, password, mqtt_username, mqtt_password);
+
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+    autoLightSleep = beginLightSleep(lightSleepCpuMhz);
+    LOG_INFO("Low power: modem sleep, %s", autoLightSleep ? "automatic light sleep" : "no light sleep in this core");
+    wokeAtUs = esp_timer_get_time();
+#endif
 }
 
 
@@ -72,129 +273,399 @@ void setup()
  */
 void loop() 
 {
-    // Check WiFi connection
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("WiFi disconnected! Reconnecting...");
-      connectWiFi();
-    }
+    uint32_t loopStart = cycleCount();
 
-    // Check MQTT connection
-    if (!mqtt_client.connected()) {
-      Serial.println("MQTT disconnected! Reconnecting...");
-      connectMQTT();
+    // Keep WiFi/MQTT up and process incoming messages (never blocks)
+    connection.loop();
+    mqttLatency.record(loopStart);
+    // Send anything queued while the broker was unreachable (rate limited)
+    outbox.loop(mqtt_client);
+
+    // Start SNTP once the network is up, and follow each of its syncs
+    if (connection.connected()) {
+        sntpBegin();
+    }
+    int64_t syncedEpochMs;
+    unsigned long syncedAt;
+    if (sntpTakeSync(syncedEpochMs, syncedAt)) {
+        wallClock.sync(syncedEpochMs, syncedAt);
+        LOG_INFO("Clock synced via SNTP");
+    }
+    wallClock.update(millis());
+
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+    // One burst reading per sampling period
+    static unsigned long lastReadingAt = 0;
+    static uint16_t ema = 0;
+    static bool emaValid = false;
+    if (lastReadingAt == 0 || millis() - lastReadingAt >= lowPowerSampleMs) {
+        lastReadingAt = millis();
+        addReading(readLightBurst(ema, emaValid));
     }
+    pollButton();
+#else
+    // Collect decimated sensor windows from the sampler
+    LightWindow window;
+    while (lightSampler.read(window)) {
+        addReading(window);
+    }
+#endif
 
-    // Process incoming MQTT messages
-    mqtt_client.loop();
+    unsigned long currentTime = millis();
 
-    // Sensor Reading and Printing
-    static unsigned long lastSensorReadTime = 0;
-    const unsigned long sensorReadInterval = 5000; // 5 seconds
+    // Publish (or queue) the batch once it is full or old enough
+    if (sensorBatch.due(currentTime)) {
+        static uint8_t sensorMessage[2048];
+        size_t samples = sensorBatch.batchSize();
+        size_t length = sensorBatch.encode(telemetryTimebase(), sensorMessage, sizeof(sensorMessage));
+
+        if (length > 0 && outbox.publish(mqtt_client, mqtt_topic_sensor, sensorMessage, length)) {
+            sensorBatch.pop(samples);
+            LOG_DEBUG("Sensor batch sent or queued: %u samples", (unsigned)samples);
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+            publishLatency.record(loopStart);
+#endif
+        } 
+        else {
+            LOG_WARN("Failed to publish sensor batch to MQTT");
+        }
+    }
 
-    unsigned long currentTime = millis();
-    if (currentTime - lastSensorReadTime >= sensorReadInterval) {
-      
-        lastSensorReadTime = currentTime;
+    // Drain button edges captured by the ISR and debounce them
+    ButtonEdge edge;
+    while (buttonEdges.pop(edge)) {
+        buttonDebouncer.addEdge(edge.level, edge.timeUs);
+    }
 
-        // read sensor
-        int sensorValue = analogRead(lightSensorPin);
-        Serial.print("Light Sensor Value: ");
-        Serial.println(sensorValue);
+    // Detect Button Events
+    if (buttonDebouncer.poll(esp_timer_get_time(), edge)) {
 
-        // Publish to MQTT (if connected)
-        JsonDocument doc;
-        doc["light"] = sensorValue;
-        doc["timestamp"] = millis();
+        bool pressed = edge.level == HIGH;
+        LOG_INFO("Button %s", pressed ? "Pressed" : "Released");
 
-        char sensorMessage[256];
-        serializeJson(doc, sensorMessage);
+        // Stamp the event with the edge time (same base as millis(), converted to epoch ms)
+        uint8_t btnEventMsg[64];
+        size_t btnEventLen = encodeButtonEvent(pressed, buttonSeq++, (uint32_t)(edge.timeUs / 1000),
+                                               telemetryTimebase(), btnEventMsg, sizeof(btnEventMsg));
 
-        if (mqtt_client.publish(mqtt_topic_sensor, sensorMessage)) {
-            Serial.println("Sensor value published to MQTT");
+        // Publish now, or queue until the broker is back
+        if (outbox.publish(mqtt_client, mqtt_topic_button, btnEventMsg, btnEventLen)) {
+            LOG_DEBUG("Button event sent or queued");
         } 
         else {
-            Serial.println("Failed to publish sensor value to MQTT");
+            LOG_WARN("Button event dropped");
         }
     }
 
-    // Detect Button Events
-    static int lastButtonState = LOW;
-    int currentButtonState = digitalRead(buttonPin);
+    metrics.loop(mqtt_client, mqtt_topic_metrics);
+    loopLatency.record(loopStart);
+
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+    // Idle until the next button poll: the CPU light-sleeps (or the modem
+    // alone does) inside delay()
+    int64_t idleFrom = esp_timer_get_time();
+    activeUs += idleFrom - wokeAtUs;
+    delay(buttonPollMs);
+    wokeAtUs = esp_timer_get_time();
+    idleUs += wokeAtUs - idleFrom;
+#endif
+}
+
+/*************************
+ * FUNCTIONS
+ */
+Timebase telemetryTimebase()
+{
+#if LAB3_POWER_MODE == LAB3_POWER_DEEP_SLEEP
+    // Stamps are on the system time, which survives deep sleep
+    int64_t now = systemTimeMs();
+    return { retained.clockSynced, now, (uint32_t)now };
+#else
+    unsigned long now = millis();
+    return { wallClock.synced(), wallClock.epochMs(now), (uint32_t)now };
+#endif
+}
 
-    static unsigned long lastDebounceTime = 0;
-    currentTime = millis();
+void addReading(const LightWindow& window)
+{
+    if (!sensorFilter.update(window.mean, window.timestamp)) {
+        return;
+    }
+    LightSample sample;
+    sample.light = window.mean;
+    sample.min = window.min;
+    sample.max = window.max;
+    sample.ema = window.ema;
+    sample.timestamp = window.timestamp;
+    sensorBatch.push(sample, window.timestamp);
+}
+
+LightWindow readLightBurst(uint16_t& ema, bool& emaValid)
+{
+    LightWindow window;
+    uint32_t sum = 0;
+    window.min = UINT16_MAX;
+    window.max = 0;
+    for (size_t i = 0; i < lowPowerBurstSize; i++) {
+        uint16_t value = analogRead(lightSensorPin);
+        sum += value;
+        window.min = value < window.min ? value : window.min;
+        window.max = value > window.max ? value : window.max;
+    }
+    window.mean = sum / lowPowerBurstSize;
+    window.count = lowPowerBurstSize;
+    window.timestamp = millis();
+
+    // Readings are seconds apart, so the EMA follows them more closely
+    // than the sampler's per-sample one
+    ema = emaValid ? ema + ((int32_t)window.mean - ema) / 4 : window.mean;
+    emaValid = true;
+    window.ema = ema;
+    return window;
+}
 
-    if (currentButtonState != lastButtonState && (currentTime - lastDebounceTime) > 100) {
+#if LAB3_POWER_MODE == LAB3_POWER_LIGHT_SLEEP
+void pollButton()
+{
+    static int lastLevel = -1;
+    int level = digitalRead(buttonPin);
+    if (level != lastLevel) {
+        lastLevel = level;
+        buttonEdges.push({ (uint8_t)level, esp_timer_get_time() });
+    }
+}
+#endif
 
-        lastButtonState = currentButtonState;
+#if LAB3_POWER_MODE == LAB3_POWER_DEEP_SLEEP
+void bufferSample(const LightWindow& window)
+{
+    if (retained.sampleCount == deepSleepMaxSamples) {
+        // Offline for too long: drop the oldest reading
+        memmove(&retained.samples[0], &retained.samples[1], sizeof(LightSample) * (deepSleepMaxSamples - 1));
+        retained.sampleCount--;
+        retained.samplesDropped++;
+    }
+    LightSample& sample = retained.samples[retained.sampleCount++];
+    sample.light = window.mean;
+    sample.min = window.min;
+    sample.max = window.max;
+    sample.ema = window.ema;
+    sample.timestamp = (uint32_t)systemTimeMs();
+    sample.seq = retained.nextSampleSeq++;
+}
 
-        lastDebounceTime = currentTime;
+void bufferButtonEvent(bool pressed)
+{
+    if (retained.buttonCount == deepSleepMaxButtons) {
+        memmove(&retained.buttons[0], &retained.buttons[1], sizeof(RetainedButtonEvent) * (deepSleepMaxButtons - 1));
+        retained.buttonCount--;
+    }
+    retained.buttons[retained.buttonCount++] = { pressed, retained.nextButtonSeq++, (uint32_t)systemTimeMs() };
+    retained.buttonHeld = pressed;
+    LOG_INFO("Button %s", pressed ? "Pressed" : "Released");
+}
 
-        String buttonStr = "";
-        
-        if (currentButtonState == HIGH) {
-            buttonStr = "pressed";  
-            Serial.println("Button Pressed");
-        } 
-        else {
-            buttonStr = "released";
-            Serial.println("Button Released");
+// Follows an SNTP sync: the system time jumps, so move the buffered
+// stamps (taken on the old time base) along with it
+void applyClockSync()
+{
+    int64_t epochMs;
+    unsigned long atMs;
+    if (!sntpTakeSync(epochMs, atMs)) {
+        return;
+    }
+    uint32_t shift = (uint32_t)(epochMs - (bootSystemMs + (int64_t)atMs));
+    for (uint32_t i = 0; i < retained.sampleCount; i++) {
+        retained.samples[i].timestamp += shift;
+    }
+    for (uint32_t i = 0; i < retained.buttonCount; i++) {
+        retained.buttons[i].timestamp += shift;
+    }
+    bootSystemMs = epochMs - (int64_t)atMs;
+    retained.clockSynced = true;
+    retained.syncedAtMs = epochMs;
+    LOG_INFO("Clock synced via SNTP");
+}
+
+bool connectForPublish()
+{
+    mqtt_client.setServer(mqtt_broker, mqtt_port);
+    mqtt_client.setBufferSize(2176);  // room for a full sensor batch
+    connection.begin(ssid, password, mqtt_username, mqtt_password);
+
+    unsigned long start = millis();
+    while (!connection.connected() && millis() - start < deepSleepConnectTimeoutMs) {
+        connection.loop();
+        delay(10);
+    }
+    if (!connection.connected()) {
+        LOG_WARN("No connection, keeping %u readings for the next wake", (unsigned)retained.sampleCount);
+        return false;
+    }
+
+    // Get real timestamps on the batch when the RTC clock is unset or stale
+    if (!retained.clockSynced || systemTimeMs() - retained.syncedAtMs >= sntpResyncMs) {
+        sntpBegin();
+        start = millis();
+        while (!retained.clockSynced && millis() - start < sntpWaitMs) {
+            applyClockSync();
+            delay(10);
         }
+    }
+    return true;
+}
 
-        JsonDocument doc;
-        doc["event"] = buttonStr;
-        doc["timestamp"] = millis();
-        
-        char btnEventMsg[256];
-        serializeJson(doc, btnEventMsg);
+// Publishes the buffered readings and button events, dropping what was sent
+void publishRetained()
+{
+    applyClockSync();
+    Timebase timebase = telemetryTimebase();
+
+    // retained.samples is the copy that counts: drop whatever an earlier,
+    // interrupted call left in the batch so no reading goes out twice
+    sensorBatch.pop(sensorBatch.size());
+    if (retained.sampleCount > 0) {
+        sensorBatch.setNextSeq(retained.samples[0].seq);
+        for (uint32_t i = 0; i < retained.sampleCount; i++) {
+            sensorBatch.push(retained.samples[i], millis());
+        }
+    }
+    uint32_t sent = 0;
+    while (sensorBatch.size() > 0) {
+        static uint8_t sensorMessage[2048];
+        size_t samples = sensorBatch.batchSize();
+        size_t length = sensorBatch.encode(timebase, sensorMessage, sizeof(sensorMessage));
+        if (length == 0 || !mqtt_client.publish(mqtt_topic_sensor, sensorMessage, length)) {
+            LOG_WARN("Failed to publish sensor batch to MQTT");
+            break;
+        }
+        if (sent == 0) {
+            retained.lastWakeToPublishMs = millis();
+        }
+        sensorBatch.pop(samples);
+        sent += samples;
+    }
+    retained.sampleCount -= sent;
+    memmove(&retained.samples[0], &retained.samples[sent], sizeof(LightSample) * retained.sampleCount);
+
+    sent = 0;
+    while (sent < retained.buttonCount) {
+        const RetainedButtonEvent& event = retained.buttons[sent];
+        uint8_t btnEventMsg[64];
+        size_t btnEventLen = encodeButtonEvent(event.pressed, event.seq, event.timestamp,
+                                               timebase, btnEventMsg, sizeof(btnEventMsg));
+        if (btnEventLen == 0 || !mqtt_client.publish(mqtt_topic_button, btnEventMsg, btnEventLen)) {
+            LOG_WARN("Button event not sent, retrying on the next wake");
+            break;
+        }
+        sent++;
+    }
+    retained.buttonCount -= sent;
+    memmove(&retained.buttons[0], &retained.buttons[sent], sizeof(RetainedButtonEvent) * retained.buttonCount);
+}
 
-        // Publish to MQTT (if connected)
-        if (mqtt_client.publish(mqtt_topic_button, btnEventMsg)) {
-            Serial.println("Button event published to MQTT");
-        } 
+// Keeps the session up until the button has been released (debounced) or
+// the wait runs out; returns true if it was released
+bool waitForButtonRelease()
+{
+    unsigned long start = millis();
+    unsigned long lowSince = 0;
+    bool low = false;
+    while (millis() - start < buttonReleaseWaitMs) {
+        if (digitalRead(buttonPin) == LOW) {
+            if (!low) {
+                low = true;
+                lowSince = millis();
+            }
+            else if (millis() - lowSince >= buttonDebounceUs / 1000) {
+                return true;
+            }
+        }
         else {
-            Serial.println("Failed to publish button event to MQTT");
+            low = false;
         }
+        connection.loop();
+        delay(5);
     }
+    return false;
 }
 
-/*************************
- * FUNCTIONS
- */
-// Function to connect to WiFi
-void connectWiFi(void) 
+void publishPowerReport()
 {
-  Serial.println("\nConnecting to WiFi...");
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
+    metrics.addCounter("wakes", []() { return retained.wakes; });
+    metrics.addCounter("wake_to_publish_ms", []() { return retained.lastWakeToPublishMs; });
+    metrics.addCounter("awake_ms", []() { return retained.lastAwakeMs; });
+    metrics.addCounter("est_current_ua", []() {
+        uint32_t awakeMs = retained.radioMs + retained.cpuMs;
+        uint32_t awakeUa = averageCurrent(retained.radioMs, wifiActiveUa, retained.cpuMs, cpuActiveUa);
+        return averageCurrent(awakeMs, awakeUa, retained.sleepMs, deepSleepUa);
+    });
+    metrics.addCounter("samples_dropped", []() { return retained.samplesDropped; });
+    metrics.addCounter("wifi_connect_ms", []() { return (uint32_t)connection.wifiConnectMs(); });
+    metrics.setTimebase(telemetryTimebase);
+
+    static char message[768];
+    size_t length = metrics.encode(message, sizeof(message));
+    if (length > 0 && mqtt_client.publish(mqtt_topic_metrics, reinterpret_cast<const uint8_t*>(message), length)) {
+        retained.radioMs = 0;
+        retained.cpuMs = 0;
+        retained.sleepMs = 0;
+    }
 }
 
-//-------------------------------------------
-// Function to connect/reconnect to MQTT broker
-void connectMQTT(void) 
+void deepSleepCycle()
 {
-  while (!mqtt_client.connected()) {
-    Serial.println("Connecting to MQTT broker...");
-    
-    String client_id = "esp32-client-" + String(WiFi.macAddress());
-    
-    if (mqtt_client.connect(client_id.c_str(), mqtt_username, mqtt_password)) {
-      Serial.println("Connected to MQTT broker!");
-    } 
-    else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.println(mqtt_client.state());
-      Serial.println("Retrying in 5 seconds...");
-      delay(5000);
-    }
-  }
-}
\ No newline at end of file
+    Serial.begin(115200);
+    logBegin();
+    bootSystemMs = systemTimeMs() - (int64_t)millis();
+    WakeCause cause = wakeCause();
+    retained.wakes++;
+    pinMode(buttonPin, INPUT);
+
+    bufferSample(readLightBurst(retained.ema, retained.emaValid));
+    bool pressed = digitalRead(buttonPin) == HIGH;
+    if ((cause == WAKE_PIN || pressed) && !retained.buttonHeld) {
+        bufferButtonEvent(true);
+    }
+    if (!pressed && retained.buttonHeld) {
+        bufferButtonEvent(false);
+    }
+
+    bool radio = false;
+    if (retained.sampleCount >= deepSleepBatchSize || retained.buttonCount > 0) {
+        radio = true;
+        if (connectForPublish()) {
+            publishRetained();
+            if (retained.buttonHeld && waitForButtonRelease()) {
+                bufferButtonEvent(false);
+                publishRetained();
+            }
+            retained.lastAwakeMs = millis();
+            publishPowerReport();
+            mqtt_client.disconnect();
+            delay(deepSleepFlushMs);
+        }
+    }
+
+    // Sleep for the rest of the sampling period. While the button is still
+    // held its level would wake us straight away, so use the timer only.
+    uint32_t awakeMs = millis();
+    uint32_t sleepMs = awakeMs + 100 < lowPowerSampleMs ? lowPowerSampleMs - awakeMs : 100;
+    (radio ? retained.radioMs : retained.cpuMs) += awakeMs;
+    retained.sleepMs += sleepMs;
+    LOG_INFO("Awake %lu ms (%s), %u readings buffered, sleeping %lu ms",
+             (unsigned long)awakeMs, radio ? "published" : "sampled",
+             (unsigned)retained.sampleCount, (unsigned long)sleepMs);
+    Serial.flush();
+    deepSleep(sleepMs, retained.buttonHeld ? -1 : buttonPin, HIGH);
+}
+#endif
+
+// GPIO interrupt on buttonPin (both edges)
+void IRAM_ATTR onButtonEdge()
+{
+  ButtonEdge edge;
+  edge.level = digitalRead(buttonPin);
+  edge.timeUs = esp_timer_get_time();
+  buttonEdges.push(edge);
+}
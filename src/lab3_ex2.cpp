@@ -1,41 +1,89 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <soc/gpio_struct.h>
+#include "ConnectionManager.h"
+#include "Log.h"
+#include "TopicDispatcher.h"
+#include "PayloadParser.h"
+#include "LedScene.h"
+#include "NodeConfig.h"
+
+#if !NODE_HAS_LEDS
+#error "lab3_ex2 needs a node profile with the LEDs"
+#endif
 
 
 // GLOBAL DECLARATIONS
-const int redLEDPin = 26;    // GPIO pin for Red LED
-const int greenLEDPin = 27;  // GPIO pin for Green LED 
-const int blueLEDPin = 14;   // GPIO pin for Blue LED
-const int yellowLEDPin = 12; // GPIO pin for Yellow LED
+const int redLEDPin = NODE_PIN_LED_RED;       // GPIO pin for Red LED
+const int greenLEDPin = NODE_PIN_LED_GREEN;   // GPIO pin for Green LED
+const int blueLEDPin = NODE_PIN_LED_BLUE;     // GPIO pin for Blue LED
+const int yellowLEDPin = NODE_PIN_LED_YELLOW; // GPIO pin for Yellow LED
 
 // WiFi credentials
-const char* ssid = "MaxPC";
-const char* password = "polito2025";
+const char* ssid = NODE_WIFI_SSID;
+const char* password = NODE_WIFI_PASSWORD;
 
 // MQTT Broker settings
-const char* mqtt_broker = "mqtt.iotserver.uz";  // Free public MQTT broker
-const int mqtt_port = 1883;
-const char* mqtt_username = "userTTPU";  // username given in the telegram group
-const char* mqtt_password = "mqttpass";  // password given in the telegram group
-
-const char* mqtt_topic_red = "ttpu/iot/maqsud/led/red";
-const char* mqtt_topic_green = "ttpu/iot/maqsud/led/green";
-const char* mqtt_topic_blue = "ttpu/iot/maqsud/led/blue";
-const char* mqtt_topic_yellow = "ttpu/iot/maqsud/led/yellow";
+const char* mqtt_broker = NODE_MQTT_BROKER;
+const int mqtt_port = NODE_MQTT_PORT;
+const char* mqtt_username = NODE_MQTT_USERNAME;
+const char* mqtt_password = NODE_MQTT_PASSWORD;
+
+// LED commands arrive on led/<color>: one wildcard subscription, routed by
+// the last topic segment. led/all sets several LEDs in one message.
+constexpr const char* mqtt_topic_led_prefix = NODE_TOPIC("led/");
+constexpr const char* mqtt_topic_leds = NODE_TOPIC("led/+");
+
+// Channels of the combined led/all command; bit i of a mask is led_channels[i]
+constexpr LedChannel led_channels[] = {
+  { "red", redLEDPin },
+  { "green", greenLEDPin },
+  { "blue", blueLEDPin },
+  { "yellow", yellowLEDPin },
+};
+static_assert(redLEDPin < 32 && greenLEDPin < 32 && blueLEDPin < 32 && yellowLEDPin < 32,
+              "LED masks only cover GPIO 0-31");
+
+// Latency benchmark (client/bench.py): each ping drives benchLedPin and is
+// echoed on the pong topic with its receive/actuate times
+constexpr const char* mqtt_topic_ping = NODE_TOPIC("bench/ping");
+const char* mqtt_topic_pong = NODE_TOPIC("bench/pong");
+const int benchLedPin = yellowLEDPin;
 
 
 WiFiClient espClient;
 PubSubClient mqtt_client(espClient);
+ConnectionManager connection(espClient, mqtt_client);
 
 
-// Function to connect to WiFi
-void connectWiFi();
 // Callback function for received MQTT messages
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-// Function to connect/reconnect to MQTT broker
-void connectMQTT();
+// Applies an LED command payload to the LED on ledPin
+void handleLedMessage(uint8_t* payload, unsigned int length, int ledPin);
+// Applies a combined command (see LedScene.h) to all LEDs at once
+void handleLedScene(uint8_t* payload, unsigned int length, int unused);
+// Applies a benchmark ping to ledPin and publishes the pong
+void handlePing(uint8_t* payload, unsigned int length, int ledPin);
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed);
+
+// LED color (last segment of led/+) -> handler routes, hashed at compile time
+constexpr TopicRoute led_routes[] = {
+  { topicHash("red"),    "red",    handleLedMessage, redLEDPin },
+  { topicHash("green"),  "green",  handleLedMessage, greenLEDPin },
+  { topicHash("blue"),   "blue",   handleLedMessage, blueLEDPin },
+  { topicHash("yellow"), "yellow", handleLedMessage, yellowLEDPin },
+  { topicHash("all"),    "all",    handleLedScene,   0 },
+};
+TopicDispatcher<16> led_dispatcher;
+
+// Full topic -> handler routes for everything else
+constexpr TopicRoute mqtt_routes[] = {
+  { topicHash(mqtt_topic_ping), mqtt_topic_ping, handlePing, benchLedPin },
+};
+TopicDispatcher<8> mqtt_dispatcher;
 
 /*************************
  * SETUP
@@ -43,6 +91,7 @@ void connectMQTT();
 void setup() {
   Serial.begin(115200);
   delay(1000);
+  logBegin();
 
   pinMode(redLEDPin, OUTPUT);
   pinMode(greenLEDPin, OUTPUT);
@@ -54,18 +103,18 @@ void setup() {
   digitalWrite(blueLEDPin, LOW);
   digitalWrite(yellowLEDPin, LOW);
   
-  Serial.println("\n===== MQTT Basic Example =====");
-  Serial.println("Your Name, Lab 3 - Ex 2");
-  
-  // Connect to WiFi
-  connectWiFi();
+  LOG_INFO("===== MQTT Basic Example =====");
+  LOG_INFO("Your Name, Lab 3 - Ex 2");
   
   // Setup MQTT
   mqtt_client.setServer(mqtt_broker, mqtt_port);
   mqtt_client.setCallback(mqttCallback);
+  led_dispatcher.on(led_routes);
+  mqtt_dispatcher.on(mqtt_routes);
+  connection.setOnConnected(onMqttConnected);
   
-  // Connect to MQTT broker
-  connectMQTT();
+  // Start WiFi + MQTT (connects in the background from loop())
+  connection.begin(ssid, password, mqtt_username, mqtt_password);
 }
 
 
@@ -73,20 +122,8 @@ void setup() {
  * LOOP
  */
 void loop() {
-  // Check WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected! Reconnecting...");
-    connectWiFi();
-  }
-  
-  // Check MQTT connection
-  if (!mqtt_client.connected()) {
-    Serial.println("MQTT disconnected! Reconnecting...");
-    connectMQTT();
-  }
-  
-  // Process incoming MQTT messages
-  mqtt_client.loop();
+  // Keep WiFi/MQTT up and process incoming messages (never blocks)
+  connection.loop();
   
 }
 
@@ -94,114 +131,107 @@ void loop() {
  * FUNCTIONS
  */
 //-------------------------------------------
-// Function to connect to WiFi
-void connectWiFi() 
+// Callback function for received MQTT messages
+void mqttCallback(char* topic, byte* payload, unsigned int length) 
 {
-  Serial.println("\nConnecting to WiFi...");
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  LOG_DEBUG("Message received on topic: %s", topic);
+
+  const char* color = topicChild(topic, mqtt_topic_led_prefix);
+  bool handled = color != nullptr ? led_dispatcher.dispatch(color, payload, length)
+                                  : mqtt_dispatcher.dispatch(topic, payload, length);
+  if (!handled) {
+    LOG_WARN("No handler for topic %s", topic);
   }
-  
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
 }
 
 //-------------------------------------------
-// Callback function for received MQTT messages
-void mqttCallback(char* topic, byte* payload, unsigned int length) 
+// Applies an LED command payload to the LED on ledPin
+void handleLedMessage(uint8_t* payload, unsigned int length, int ledPin)
 {
-  Serial.print("Message received on topic: ");
-  Serial.println(topic);
-
-  int chosenLED = -1;
-
-  String topicStr = String(topic);
-
-  if (topicStr == String(mqtt_topic_red)) {
-    chosenLED = redLEDPin;
-  } 
-  else if (topicStr == String(mqtt_topic_green)) {
-    chosenLED = greenLEDPin;
-  } 
-  else if (topicStr == String(mqtt_topic_blue)) {
-    chosenLED = blueLEDPin;
-    
-  } 
-  else if (topicStr == String(mqtt_topic_yellow)) {
-    chosenLED = yellowLEDPin;
-  }
-  
-  // Convert payload to String
-  String message = "";
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-  Serial.print("Message content: ");
-  Serial.println(message);
-  Serial.println("---");
-  
+  LOG_DEBUG("Message content: %.*s", (int)length, (const char*)payload);
 
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message.c_str());
-  if (error) {
-    Serial.print("Failed to parse JSON: ");
-    Serial.println(error.c_str());
+  // Empty payload: the dashboard cleared the retained per-LED state
+  if (length == 0) {
     return;
   }
 
-  // String state_val = "";
-  // if (doc.containsKey("state") == true) {
-  //   state_val = doc["state"].as<String>();
-  // }
-
-  const char* state_cstr = doc["state"].is<const char*>() ? doc["state"].as<const char*>() : nullptr;
-  String state_val = state_cstr ? String(state_cstr) : "";
+  // Parse {"state":"ON"|"OFF"} in place, straight from the MQTT buffer
+  JsonToken state;
+  if (!jsonFindString(payload, length, "state", state)) {
+    LOG_WARN("Failed to parse LED command");
+    return;
+  }
 
   int ledState = -1;
 
-  if (state_val == "ON"){
+  if (tokenEquals(state, "ON")){
     ledState = HIGH;
   }
-  else if (state_val == "OFF"){
+  else if (tokenEquals(state, "OFF")){
     ledState = LOW;
   }
 
-  if (chosenLED != -1 && ledState != -1) {
-    digitalWrite(chosenLED, ledState);
+  if (ledState != -1) {
+    digitalWrite(ledPin, ledState);
   }
  
 }
 
 //-------------------------------------------
-// Function to connect/reconnect to MQTT broker
-void connectMQTT() 
+// Applies a combined command (see LedScene.h) to all LEDs at once
+void handleLedScene(uint8_t* payload, unsigned int length, int unused)
 {
-  while (!mqtt_client.connected()) {
-    Serial.println("Connecting to MQTT broker...");
-    
-    String client_id = "esp32-client-" + String(WiFi.macAddress());
-    
-    if (mqtt_client.connect(client_id.c_str(), mqtt_username, mqtt_password)) {
-      Serial.println("Connected to MQTT broker!");
-      
-      // Subscribe to topic
-      mqtt_client.subscribe(mqtt_topic_red);
-      mqtt_client.subscribe(mqtt_topic_green);
-      mqtt_client.subscribe(mqtt_topic_blue);
-      mqtt_client.subscribe(mqtt_topic_yellow);
-
-      Serial.println("Subscribed to topics");
-    } 
-    else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.println(mqtt_client.state());
-      Serial.println("Retrying in 5 seconds...");
-      delay(5000);
-    }
+  LOG_DEBUG("Message content: %.*s", (int)length, (const char*)payload);
+
+  LedChange change;
+  if (!parseLedScene(payload, length, led_channels, sizeof(led_channels) / sizeof(led_channels[0]), change)) {
+    LOG_WARN("Failed to parse LED scene");
+    return;
+  }
+
+  // Every channel switches together: one set and one clear register write
+  GPIO.out_w1ts = change.set;
+  GPIO.out_w1tc = change.clear;
+}
+
+//-------------------------------------------
+// Applies a benchmark ping {"seq":N,"state":"ON"|"OFF"} to ledPin and
+// echoes {"seq":N,"rx_us":...,"act_us":...} (esp_timer time of arrival and
+// of the digitalWrite) so the RTT can be split into network and device time
+void handlePing(uint8_t* payload, unsigned int length, int ledPin)
+{
+  int64_t rxUs = esp_timer_get_time();
+
+  uint32_t seq;
+  JsonToken state;
+  if (!jsonFindUint(payload, length, "seq", seq) || !jsonFindString(payload, length, "state", state)) {
+    LOG_WARN("Failed to parse bench ping");
+    return;
   }
+
+  digitalWrite(ledPin, tokenEquals(state, "ON") ? HIGH : LOW);
+  int64_t actUs = esp_timer_get_time();
+
+  // payload points into the client buffer, so it must not be used after this
+  char pong[80];
+  int n = snprintf(pong, sizeof(pong), "{\"seq\":%lu,\"rx_us\":%lld,\"act_us\":%lld}",
+                   (unsigned long)seq, (long long)rxUs, (long long)actUs);
+  mqtt_client.publish(mqtt_topic_pong, (const uint8_t*)pong, n);
+}
+
+//-------------------------------------------
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed) 
+{
+  // The broker kept our subscriptions (and queued any QoS 1 commands)
+  if (sessionResumed) {
+    LOG_INFO("Session resumed, subscriptions kept");
+    return;
+  }
+
+  // QoS 1: commands published while we were offline are delivered on reconnect
+  mqtt.subscribe(mqtt_topic_leds, 1);  // every LED, however many there are
+  mqtt.subscribe(mqtt_topic_ping, 1);
+
+  LOG_INFO("Subscribed to topics");
 }
\ No newline at end of file
@@ -1,47 +1,308 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
+#include <Wire.h>
+#include <hd44780.h>
+#include <hd44780ioClass/hd44780_I2Cexp.h>
 #include <ArduinoJson.h>
+#include <esp_timer.h>
+#include <soc/gpio_struct.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include "ConnectionManager.h"
+#include "Log.h"
+#include "LightSampler.h"
+#include "ButtonDebouncer.h"
+#include "SpscRing.h"
+#include "DeadbandFilter.h"
+#include "TelemetryBatch.h"
+#include "TelemetryCodec.h"
+#include "Outbox.h"
+#include "Metrics.h"
+#include "TopicDispatcher.h"
+#include "PayloadParser.h"
+#include "LedScene.h"
+#include "TokenBucket.h"
+#include "PcfLcd.h"
+#include "LcdFrameBuffer.h"
+#include "CalendarTime.h"
+#include "SntpSync.h"
+#include "OtaUpdate.h"
+
+// Runs in the Wokwi simulator unless built with another NODE_PROFILE; the
+// profile's NODE_HAS_xxx flags compile each peripheral's code in or out
+#ifndef NODE_PROFILE
+#define NODE_PROFILE NODE_PROFILE_WOKWI
+#endif
+#include "NodeConfig.h"
+
+// Architecture mode: 1 = sensor/actuator and network paths in two pinned
+// FreeRTOS tasks, 0 = both run from loop()
+#ifndef LAB3_DUAL_CORE
+#define LAB3_DUAL_CORE 0
+#endif
 
 
 // GLOBAL DECLARATIONS
-const int redLEDPin = 26;    // GPIO pin for Red LED
-const int greenLEDPin = 27;  // GPIO pin for Green LED 
-const int blueLEDPin = 14;   // GPIO pin for Blue LED
-const int yellowLEDPin = 12; // GPIO pin for Yellow LED
-
-const int lightSensorPin = 33; // GPIO pin for light sensor
-const int buttonPin = 25;      // GPIO pin for button
+#if NODE_HAS_LEDS
+const int redLEDPin = NODE_PIN_LED_RED;       // GPIO pin for Red LED
+const int greenLEDPin = NODE_PIN_LED_GREEN;   // GPIO pin for Green LED
+const int blueLEDPin = NODE_PIN_LED_BLUE;     // GPIO pin for Blue LED
+const int yellowLEDPin = NODE_PIN_LED_YELLOW; // GPIO pin for Yellow LED
+#endif
+
+#if NODE_HAS_SENSOR
+const int lightSensorPin = NODE_PIN_LIGHT; // GPIO pin for light sensor
+#endif
+#if NODE_HAS_BUTTON
+const int buttonPin = NODE_PIN_BUTTON;     // GPIO pin for button
+#endif
 
 // WiFi credentials
-const char* ssid = "Wokwi-GUEST";
-const char* password = "";
+const char* ssid = NODE_WIFI_SSID;
+const char* password = NODE_WIFI_PASSWORD;
 
 // MQTT Broker settings
-const char* mqtt_broker = "mqtt.iotserver.uz";  // Free public MQTT broker
-const int mqtt_port = 1883;
-const char* mqtt_username = "userTTPU";  // username given in the telegram group
-const char* mqtt_password = "mqttpass";  // password given in the telegram group
-
-const char* mqtt_topic_red = "ttpu/iot/maqsud/led/red";
-const char* mqtt_topic_green = "ttpu/iot/maqsud/led/green";
-const char* mqtt_topic_blue = "ttpu/iot/maqsud/led/blue";
-const char* mqtt_topic_yellow = "ttpu/iot/maqsud/led/yellow";
-
-const char* mqtt_topic_sensor = "ttpu/iot/maqsud/sensors/light"; 
-const char* mqtt_topic_button = "ttpu/iot/maqsud/events/button";
+const char* mqtt_broker = NODE_MQTT_BROKER;
+const int mqtt_port = NODE_MQTT_PORT;
+const char* mqtt_username = NODE_MQTT_USERNAME;
+const char* mqtt_password = NODE_MQTT_PASSWORD;
+
+#if NODE_HAS_LEDS
+// LED commands arrive on led/<color>: one wildcard subscription, routed by
+// the last topic segment. led/all sets several LEDs in one message.
+constexpr const char* mqtt_topic_led_prefix = NODE_TOPIC("led/");
+constexpr const char* mqtt_topic_leds = NODE_TOPIC("led/+");
+
+// Channels of the combined led/all command; bit i of a mask is led_channels[i]
+constexpr LedChannel led_channels[] = {
+  { "red", redLEDPin },
+  { "green", greenLEDPin },
+  { "blue", blueLEDPin },
+  { "yellow", yellowLEDPin },
+};
+constexpr size_t ledChannelCount = sizeof(led_channels) / sizeof(led_channels[0]);
+static_assert(redLEDPin < 32 && greenLEDPin < 32 && blueLEDPin < 32 && yellowLEDPin < 32,
+              "LED masks only cover GPIO 0-31");
+
+// LED command policing, so a flood on led/+ cannot starve the I/O path:
+// each LED topic (and led/all) has a token bucket, and a command that finds
+// it empty is dropped before it is parsed; the accepted ones are merged so
+// only the latest state per LED goes to the I/O side per window
+const uint16_t ledCommandBurst = 8;            // commands per topic back to back
+const unsigned long ledCommandRefillMs = 100;  // then 10 per second sustained
+const unsigned long ledCoalesceWindowMs = 20;  // at most 50 LED updates per second
+TokenBucket ledBuckets[ledChannelCount + 1] = {  // led_channels order, then led/all
+  { ledCommandBurst, ledCommandRefillMs },
+  { ledCommandBurst, ledCommandRefillMs },
+  { ledCommandBurst, ledCommandRefillMs },
+  { ledCommandBurst, ledCommandRefillMs },
+  { ledCommandBurst, ledCommandRefillMs },
+};
+LedCoalescer ledPending;
+unsigned long ledFlushedAt = 0;
+
+// Latency benchmark (client/bench.py): each ping drives the LED
+// led_channels[benchLedChannel] through the same bucket and coalescer as
+// the LED commands, and is echoed on the pong topic with its
+// receive/actuate times
+constexpr const char* mqtt_topic_ping = NODE_TOPIC("bench/ping");
+const char* mqtt_topic_pong = NODE_TOPIC("bench/pong");
+const int benchLedChannel = 3;  // yellow
+#endif
+
+const char* mqtt_topic_sensor = NODE_TOPIC("sensors/light");
+const char* mqtt_topic_button = NODE_TOPIC("events/button");
+const char* mqtt_topic_metrics = NODE_TOPIC("metrics");
+constexpr const char* mqtt_topic_display = NODE_TOPIC("display");  // {"text":"..."}
+
+#if NODE_HAS_OTA
+// Signed firmware update commands (client/ota.py); progress and outcome are
+// published retained on the status topic
+constexpr const char* mqtt_topic_ota = NODE_TOPIC("ota");
+const char* mqtt_topic_ota_status = NODE_TOPIC("ota/status");
+// A new image must reach the broker within this time of booting, or the
+// previous one is restored
+const unsigned long otaConfirmTimeoutMs = 120000;
+OtaUpdater ota(NODE_OTA_KEY, NODE_FIRMWARE_VERSION);
+#endif
+
+#if NODE_HAS_SENSOR
+// Sensor sampling and batching: a hardware timer samples the ADC at 1 kHz,
+// every 20 samples are decimated into one reading (50 Hz), and readings are
+// published 25 per message or once per second, whichever comes first
+const uint32_t sensorSampleRateHz = 1000;      // ADC samples per second
+const size_t sensorWindowSize = 20;            // samples per published reading
+const size_t sensorBatchSize = 25;             // readings per message
+const unsigned long sensorBatchMaxAge = 1000;  // ms before a partial batch is sent
+LightSampler lightSampler;
+TelemetryBatch sensorBatch(sensorBatchSize, sensorBatchMaxAge);
+
+// Report by exception: a reading is only published when it moves by at least
+// the deadband, or when the sensor has been silent for the heartbeat period
+const uint16_t sensorDeadband = 40;              // ADC counts (~1% of full scale)
+const unsigned long sensorHeartbeatMs = 30000;   // max silence while stable
+DeadbandFilter sensorFilter(sensorDeadband, sensorHeartbeatMs);
+#endif
+
+#if NODE_HAS_BUTTON
+// Button edges: the ISR timestamps every edge and queues it, loop() debounces
+const int64_t buttonDebounceUs = 50000;  // 50 ms quiet time
+SpscRing<ButtonEdge, 32> buttonEdges;
+ButtonDebouncer buttonDebouncer(buttonDebounceUs, LOW);
+
+// GPIO interrupt on buttonPin (both edges)
+void IRAM_ATTR onButtonEdge();
+uint32_t buttonSeq = 0;  // sequence number of the next button event
+#endif
+
+// The sensor/actuator path and the network path only exchange data through
+// these queues. With -DLAB3_DUAL_CORE each path runs in its own pinned
+// FreeRTOS task; otherwise loop() runs both in turn.
+#if NODE_HAS_LEDS
+struct LedCommand {
+  LedChange change;  // output pins to set/clear
+  uint32_t seq;      // bench ping sequence number, 0 for regular commands
+  int64_t rxUs;      // bench ping arrival time
+};
+struct BenchPong {
+  uint32_t seq;
+  int64_t rxUs;
+  int64_t actUs;  // time the outputs were written
+};
+QueueHandle_t ledQueue;     // LedCommand, net -> io
+QueueHandle_t pongQueue;    // BenchPong, io -> net
+#endif
+#if NODE_HAS_SENSOR
+QueueHandle_t sensorQueue;  // LightSample, io -> net
+#endif
+#if NODE_HAS_BUTTON
+QueueHandle_t buttonQueue;  // ButtonEdge (debounced), io -> net
+#endif
+
+#if NODE_HAS_LCD
+// I2C LCD showing the text from mqtt_topic_display. The MQTT callback only
+// overwrites a one-slot queue; displayStep() takes the newest text once per
+// refresh tick, so a burst of updates costs one (slow) I2C write and never
+// holds up the network path.
+#if LCD_FAST_IO
+PcfLcd lcd(NODE_LCD_I2C_ADDRESS);  // PCF8574 backpack at 400 kHz, one I2C transmission per changed run
+#else
+hd44780_I2Cexp lcd;  // Auto-detect I2C address
+#endif
+const int LCD_COLS = NODE_LCD_COLS;
+const int LCD_ROWS = NODE_LCD_ROWS;
+const unsigned long displayRefreshMs = 200;
+LcdFrameBuffer<LCD_COLS, LCD_ROWS> frame;  // only changed cells go over I2C
+bool lcdReady = false;
+struct DisplayText {
+  char text[LCD_COLS + 1];
+};
+QueueHandle_t displayQueue;  // DisplayText, net -> display, newest only
+uint32_t displayCoalesced = 0;  // texts replaced before they were shown
+#endif
+
+// Wall clock shown on the LCD's second row: runs from clockStart at boot
+// until SNTP has synced, then follows it. The network path syncs it and
+// the display path reads it, hence the lock.
+const CalendarTime clockStart = { 2025, 1, 15, 10, 30, 0 };  // 15/01/2025 10:30:00
+const long clockUtcOffsetS = 5 * 3600;                       // UTC+5 (Tashkent)
+CalendarClock wallClock(clockStart, clockUtcOffsetS);
+portMUX_TYPE wallClockLock = portMUX_INITIALIZER_UNLOCKED;
+// Snapshot of wallClock for encoding timestamps (see TelemetryCodec.h)
+Timebase telemetryTimebase();
+
+// Sensor/actuator path
+void ioStep();
+// Network path
+void netStep();
+#if NODE_HAS_LCD
+// LCD refresh
+void displayStep();
+#endif
+#if LAB3_DUAL_CORE
+void ioTask(void* arg);
+void netTask(void* arg);
+#if NODE_HAS_LCD
+void displayTask(void* arg);
+#endif
+#endif
 
 
 WiFiClient espClient;
 PubSubClient mqtt_client(espClient);
+ConnectionManager connection(espClient, mqtt_client);
+
+// Store-and-forward: messages produced while the broker is unreachable are
+// queued (RAM first, then flash) and drained at this rate once it is back
+const unsigned long outboxDrainIntervalMs = 50;  // ~20 messages per second
+const size_t outboxSpillLimit = 64 * 1024;       // bytes on LittleFS
+Outbox outbox(outboxDrainIntervalMs);
+
+// Runtime metrics (latency histograms, counters, heap), published as JSON
+const unsigned long metricsIntervalMs = 10000;
+Metrics metrics(metricsIntervalMs);
+LatencyHistogram ioLatency;    // one ioStep()
+LatencyHistogram netLatency;   // one netStep()
+LatencyHistogram mqttLatency;  // connection.loop(), i.e. mqtt_client.loop() or a connect attempt
+#if NODE_HAS_LCD
+LatencyHistogram lcdLatency;   // one LCD frame update
+#endif
 
 
-// Function to connect to WiFi
-void connectWiFi();
 // Callback function for received MQTT messages
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-// Function to connect/reconnect to MQTT broker
-void connectMQTT();
+#if NODE_HAS_LEDS
+// Queues an LED command payload for led_channels[channel]
+void handleLedMessage(uint8_t* payload, unsigned int length, int channel);
+// Queues a combined command (see LedScene.h) for all LEDs at once
+void handleLedScene(uint8_t* payload, unsigned int length, int unused);
+// Total LED commands dropped over the rate limit
+uint32_t ledRateLimited();
+// Forwards a benchmark ping for led_channels[channel] to the I/O side
+void handlePing(uint8_t* payload, unsigned int length, int channel);
+#endif
+#if NODE_HAS_LCD
+// Hands the text of a display message to displayStep()
+void handleDisplayMessage(uint8_t* payload, unsigned int length, int unused);
+#endif
+#if NODE_HAS_OTA
+// Hands a firmware update command to ota
+void handleOtaCommand(uint8_t* payload, unsigned int length, int unused);
+#endif
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed);
+
+#if NODE_HAS_LEDS
+// LED color (last segment of led/+) -> handler routes, hashed at compile time
+constexpr TopicRoute led_routes[] = {
+  { topicHash("red"),    "red",    handleLedMessage, 0 },
+  { topicHash("green"),  "green",  handleLedMessage, 1 },
+  { topicHash("blue"),   "blue",   handleLedMessage, 2 },
+  { topicHash("yellow"), "yellow", handleLedMessage, 3 },
+  { topicHash("all"),    "all",    handleLedScene,   ledChannelCount },
+};
+TopicDispatcher<16> led_dispatcher;
+#endif
+
+// Full topic -> handler routes for everything else
+TopicDispatcher<8> mqtt_dispatcher;
+#if NODE_HAS_LEDS
+constexpr TopicRoute bench_routes[] = {
+  { topicHash(mqtt_topic_ping),    mqtt_topic_ping,    handlePing,           benchLedChannel },
+};
+#endif
+#if NODE_HAS_LCD
+constexpr TopicRoute display_routes[] = {
+  { topicHash(mqtt_topic_display), mqtt_topic_display, handleDisplayMessage, 0 },
+};
+#endif
+#if NODE_HAS_OTA
+constexpr TopicRoute ota_routes[] = {
+  { topicHash(mqtt_topic_ota),     mqtt_topic_ota,     handleOtaCommand,     0 },
+};
+#endif
 
 /*************************
  * SETUP
@@ -49,10 +310,43 @@ void connectMQTT();
 void setup() {
   Serial.begin(115200);
   delay(1000);
-
+  logBegin();
+
+#if NODE_HAS_OTA
+  // First thing, so a freshly updated image that keeps crashing in setup()
+  // is still rolled back
+  ota.begin(otaConfirmTimeoutMs);
+#endif
+
+#if NODE_HAS_SENSOR
+  sensorQueue = xQueueCreate(64, sizeof(LightSample));
+#endif
+#if NODE_HAS_BUTTON
+  buttonQueue = xQueueCreate(16, sizeof(ButtonEdge));
+#endif
+#if NODE_HAS_LEDS
+  ledQueue = xQueueCreate(16, sizeof(LedCommand));
+  pongQueue = xQueueCreate(16, sizeof(BenchPong));
+#endif
+#if NODE_HAS_LCD
+  displayQueue = xQueueCreate(1, sizeof(DisplayText));
+#endif
+
+#if NODE_HAS_BUTTON
    // Initialize pins
   pinMode(buttonPin, INPUT);
+  buttonDebouncer = ButtonDebouncer(buttonDebounceUs, digitalRead(buttonPin));
+  attachInterrupt(digitalPinToInterrupt(buttonPin), onButtonEdge, CHANGE);
+#endif
+
+#if NODE_HAS_SENSOR
+  // Start timer-driven light sensor sampling
+  if (!lightSampler.begin(lightSensorPin, sensorSampleRateHz, sensorWindowSize)) {
+      LOG_ERROR("Light sensor sampler failed to start!");
+  }
+#endif
 
+#if NODE_HAS_LEDS
   pinMode(redLEDPin, OUTPUT);
   pinMode(greenLEDPin, OUTPUT);
   pinMode(blueLEDPin, OUTPUT);
@@ -62,19 +356,80 @@ void setup() {
   digitalWrite(greenLEDPin, LOW);
   digitalWrite(blueLEDPin, LOW);
   digitalWrite(yellowLEDPin, LOW);
+#endif
   
-  Serial.println("\n===== MQTT Basic Example =====");
-  Serial.println("Your Name, Lab 3 - Ex 2");
-  
-  // Connect to WiFi
-  connectWiFi();
+  LOG_INFO("===== MQTT Basic Example =====");
+  LOG_INFO("Your Name, Lab 3 - Ex 2");
   
   // Setup MQTT
   mqtt_client.setServer(mqtt_broker, mqtt_port);
+  mqtt_client.setBufferSize(2176);  // room for a full sensor batch
   mqtt_client.setCallback(mqttCallback);
+#if NODE_HAS_LEDS
+  led_dispatcher.on(led_routes);
+  mqtt_dispatcher.on(bench_routes);
+#endif
+#if NODE_HAS_LCD
+  mqtt_dispatcher.on(display_routes);
+#endif
+#if NODE_HAS_OTA
+  mqtt_dispatcher.on(ota_routes);
+#endif
+  connection.setOnConnected(onMqttConnected);
   
-  // Connect to MQTT broker
-  connectMQTT();
+  // Keep telemetry across broker outages (and reboots, via flash)
+  outbox.beginSpill("/outbox.bin", outboxSpillLimit);
+
+  // Metrics reported on mqtt_topic_metrics
+  metrics.addHistogram("io_us", ioLatency);
+  metrics.addHistogram("net_us", netLatency);
+  metrics.addHistogram("mqtt_us", mqttLatency);
+#if NODE_HAS_LCD
+  metrics.addHistogram("lcd_us", lcdLatency);
+#endif
+  metrics.addCounter("published", []() { return outbox.sent(); });
+  metrics.addCounter("publish_failures", []() { return outbox.failed(); });
+  metrics.addCounter("outbox_queued", []() { return (uint32_t)outbox.queued(); });
+  metrics.addCounter("outbox_dropped", []() { return outbox.dropped(); });
+  metrics.addCounter("reconnects", []() { return connection.reconnects(); });
+  metrics.addCounter("wifi_connect_ms", []() { return (uint32_t)connection.wifiConnectMs(); });
+#if NODE_HAS_SENSOR
+  metrics.addCounter("sampler_overruns", []() { return lightSampler.overruns(); });
+#endif
+  metrics.addCounter("log_dropped", logDropped);
+#if NODE_HAS_LEDS
+  metrics.addCounter("led_rate_limited", ledRateLimited);
+  metrics.addCounter("led_coalesced", []() { return ledPending.coalesced(); });
+#endif
+#if NODE_HAS_LCD
+  metrics.addCounter("display_coalesced", []() { return displayCoalesced; });
+#endif
+  metrics.setTimebase(telemetryTimebase);
+
+#if NODE_HAS_LCD
+  // LCD for mqtt_topic_display; everything else keeps running without one
+  int lcdStatus = lcd.begin(LCD_COLS, LCD_ROWS);
+  if (lcdStatus) {
+      LOG_ERROR("LCD initialization failed! Status code: %d", lcdStatus);
+  }
+  else {
+      lcd.clear();
+      lcdReady = true;
+  }
+#endif
+
+  // Start WiFi + MQTT (connects in the background from loop())
+  connection.begin(ssid, password, mqtt_username, mqtt_password);
+
+#if LAB3_DUAL_CORE
+  // Sensor/button/LED work at high priority on core 1, network on core 0
+  xTaskCreatePinnedToCore(ioTask, "io", 4096, nullptr, 5, nullptr, 1);
+  xTaskCreatePinnedToCore(netTask, "net", 8192, nullptr, 1, nullptr, 0);
+#if NODE_HAS_LCD
+  // LCD below the I/O task on core 1, so I2C writes only use its idle time
+  xTaskCreatePinnedToCore(displayTask, "display", 3072, nullptr, 1, nullptr, 1);
+#endif
+#endif
 }
 
 
@@ -82,205 +437,457 @@ void setup() {
  * LOOP
  */
 void loop() {
-  // Check WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected! Reconnecting...");
-    connectWiFi();
+#if LAB3_DUAL_CORE
+  // All work runs in ioTask (core 1) and netTask (core 0)
+  vTaskDelay(portMAX_DELAY);
+#else
+  ioStep();
+  netStep();
+#if NODE_HAS_LCD
+  displayStep();
+#endif
+#endif
+}
+
+//-------------------------------------------
+// Sensor/actuator path: sensor windows, button edges and LED outputs.
+// Never touches the network; only exchanges data through the queues.
+void ioStep()
+{
+  uint32_t start = cycleCount();
+
+#if NODE_HAS_SENSOR
+  // Collect decimated sensor windows from the sampler
+  LightWindow window;
+  while (lightSampler.read(window)) {
+      if (!sensorFilter.update(window.mean, window.timestamp)) {
+          continue;
+      }
+      LightSample sample;
+      sample.light = window.mean;
+      sample.min = window.min;
+      sample.max = window.max;
+      sample.ema = window.ema;
+      sample.timestamp = window.timestamp;
+      xQueueSend(sensorQueue, &sample, 0);  // dropped if the network side is far behind
   }
-  
-  // Check MQTT connection
-  if (!mqtt_client.connected()) {
-    Serial.println("MQTT disconnected! Reconnecting...");
-    connectMQTT();
+#endif
+
+#if NODE_HAS_BUTTON
+  // Drain button edges captured by the ISR and debounce them
+  ButtonEdge edge;
+  while (buttonEdges.pop(edge)) {
+      buttonDebouncer.addEdge(edge.level, edge.timeUs);
   }
-  
-  // Process incoming MQTT messages
-  mqtt_client.loop();
+  if (buttonDebouncer.poll(esp_timer_get_time(), edge)) {
+      xQueueSend(buttonQueue, &edge, 0);
+  }
+#endif
+
+#if NODE_HAS_LEDS
+  // Apply LED commands received by the network side
+  LedCommand command;
+  while (xQueueReceive(ledQueue, &command, 0) == pdTRUE) {
+      GPIO.out_w1ts = command.change.set;
+      GPIO.out_w1tc = command.change.clear;
+      if (command.seq != 0) {
+          BenchPong pong = { command.seq, command.rxUs, esp_timer_get_time() };
+          xQueueSend(pongQueue, &pong, 0);
+      }
+  }
+#endif
 
-  // Sensor Reading and Printing
-  static unsigned long lastSensorReadTime = 0;
-  const unsigned long sensorReadInterval = 5000; // 5 seconds
+  ioLatency.record(start);
+}
 
-  unsigned long currentTime = millis();
-  if (currentTime - lastSensorReadTime >= sensorReadInterval) {
-    
-      lastSensorReadTime = currentTime;
+//-------------------------------------------
+// Network path: WiFi/MQTT upkeep, batching, serialization and publishing
+void netStep()
+{
+  uint32_t start = cycleCount();
+
+  // Keep WiFi/MQTT up and process incoming messages (never blocks)
+  connection.loop();
+  mqttLatency.record(start);
+  // Send anything queued while the broker was unreachable (rate limited)
+  outbox.loop(mqtt_client);
+
+  // Follow SNTP once it has answered (and on its hourly re-syncs)
+  int64_t syncedEpochMs;
+  unsigned long syncedAt;
+  if (sntpTakeSync(syncedEpochMs, syncedAt)) {
+      portENTER_CRITICAL(&wallClockLock);
+      wallClock.sync(syncedEpochMs, syncedAt);
+      portEXIT_CRITICAL(&wallClockLock);
+      LOG_INFO("Clock synced via SNTP");
+  }
+
+#if NODE_HAS_LEDS
+  // Hand the merged LED states to the I/O side, at most once per window
+  LedCommand command = { { 0, 0 }, 0, 0 };
+  if (millis() - ledFlushedAt >= ledCoalesceWindowMs && ledPending.take(command.change)) {
+      ledFlushedAt = millis();
+      if (xQueueSend(ledQueue, &command, 0) != pdTRUE) {
+          ledPending.add(command.change);  // I/O side is behind; retry next window
+      }
+  }
+#endif
 
-      // read sensor
-      int sensorValue = analogRead(lightSensorPin);
-      Serial.print("Light Sensor Value: ");
-      Serial.println(sensorValue);
+#if NODE_HAS_SENSOR
+  LightSample sample;
+  while (xQueueReceive(sensorQueue, &sample, 0) == pdTRUE) {
+      sensorBatch.push(sample, sample.timestamp);
+  }
 
-      // Publish to MQTT (if connected)
-      JsonDocument doc;
-      doc["light"] = sensorValue;
-      doc["timestamp"] = millis();
+  unsigned long currentTime = millis();
 
-      char sensorMessage[256];
-      serializeJson(doc, sensorMessage);
+  // Publish (or queue) the batch once it is full or old enough
+  if (sensorBatch.due(currentTime)) {
+      static uint8_t sensorMessage[2048];
+      size_t samples = sensorBatch.batchSize();
+      size_t length = sensorBatch.encode(telemetryTimebase(), sensorMessage, sizeof(sensorMessage));
 
-      if (mqtt_client.publish(mqtt_topic_sensor, sensorMessage)) {
-          Serial.println("Sensor value published to MQTT");
+      if (length > 0 && outbox.publish(mqtt_client, mqtt_topic_sensor, sensorMessage, length)) {
+          sensorBatch.pop(samples);
+          LOG_DEBUG("Sensor batch sent or queued: %u samples", (unsigned)samples);
       } 
       else {
-          Serial.println("Failed to publish sensor value to MQTT");
+          LOG_WARN("Failed to publish sensor batch to MQTT");
       }
   }
+#endif
 
+#if NODE_HAS_BUTTON
   // Detect Button Events
-  static int lastButtonState = LOW;
-  int currentButtonState = digitalRead(buttonPin);
-
-  static unsigned long lastDebounceTime = 0;
-  currentTime = millis();
+  ButtonEdge edge;
+  while (xQueueReceive(buttonQueue, &edge, 0) == pdTRUE) {
 
-  if (currentButtonState != lastButtonState && (currentTime - lastDebounceTime) > 100) {
+      bool pressed = edge.level == HIGH;
+      LOG_INFO("Button %s", pressed ? "Pressed" : "Released");
 
-      lastButtonState = currentButtonState;
+      // Stamp the event with the edge time (same base as millis(), converted to epoch ms)
+      uint8_t btnEventMsg[64];
+      size_t btnEventLen = encodeButtonEvent(pressed, buttonSeq++, (uint32_t)(edge.timeUs / 1000),
+                                             telemetryTimebase(), btnEventMsg, sizeof(btnEventMsg));
 
-      lastDebounceTime = currentTime;
-
-      String buttonStr = "";
-      
-      if (currentButtonState == HIGH) {
-          buttonStr = "pressed";  
-          Serial.println("Button Pressed");
+      // Publish now, or queue until the broker is back
+      if (outbox.publish(mqtt_client, mqtt_topic_button, btnEventMsg, btnEventLen)) {
+          LOG_DEBUG("Button event sent or queued");
       } 
       else {
-          buttonStr = "released";
-          Serial.println("Button Released");
+          LOG_WARN("Button event dropped");
+      }
+  }
+#endif
+
+#if NODE_HAS_LEDS
+  // Echo benchmark pings once the I/O side has applied them (not queued:
+  // a late pong is useless to the benchmark)
+  BenchPong pong;
+  while (xQueueReceive(pongQueue, &pong, 0) == pdTRUE) {
+      char pongMsg[80];
+      int n = snprintf(pongMsg, sizeof(pongMsg), "{\"seq\":%lu,\"rx_us\":%lld,\"act_us\":%lld}",
+                       (unsigned long)pong.seq, (long long)pong.rxUs, (long long)pong.actUs);
+      mqtt_client.publish(mqtt_topic_pong, (const uint8_t*)pongMsg, n);
+  }
+#endif
+
+#if NODE_HAS_OTA
+  // Restart into a downloaded image, or roll back an unconfirmed one
+  ota.loop();
+  if (mqtt_client.connected()) {
+      char otaStatus[160];
+      size_t otaStatusLen = ota.takeStatus(otaStatus, sizeof(otaStatus));
+      if (otaStatusLen > 0) {
+          mqtt_client.publish(mqtt_topic_ota_status, (const uint8_t*)otaStatus, otaStatusLen, true);
       }
+  }
+#endif
 
-      JsonDocument doc;
-      doc["event"] = buttonStr;
-      doc["timestamp"] = millis();
-      
-      char btnEventMsg[256];
-      serializeJson(doc, btnEventMsg);
+  metrics.loop(mqtt_client, mqtt_topic_metrics);
+  netLatency.record(start);
+}
 
-      // Publish to MQTT (if connected)
-      if (mqtt_client.publish(mqtt_topic_button, btnEventMsg)) {
-          Serial.println("Button event published to MQTT");
-      } 
-      else {
-          Serial.println("Failed to publish button event to MQTT");
-      }
+#if NODE_HAS_LCD
+//-------------------------------------------
+// LCD path: the newest display text and the clock, at most once per
+// refresh tick
+void displayStep()
+{
+  static unsigned long refreshedAt = 0;
+  unsigned long now = millis();
+  if (!lcdReady || now - refreshedAt < displayRefreshMs) {
+      return;
+  }
+  refreshedAt = now;
+
+  uint32_t start = cycleCount();
+  DisplayText message;
+  if (xQueueReceive(displayQueue, &message, 0) == pdTRUE) {
+      frame.printLine(0, "%s", message.text);
+  }
+
+  portENTER_CRITICAL(&wallClockLock);
+  CalendarTime time = wallClock.update(now);
+  portEXIT_CRITICAL(&wallClockLock);
+  frame.printLine(1, "%02d/%02d %02d:%02d:%02d", time.day, time.month, time.hour, time.minute, time.second);
+
+  // Usually just the seconds digit; only frames that hit the bus are timed
+  if (frame.flush(lcd) > 0) {
+      lcdLatency.record(start);
   }
-  
 }
+#endif
 
-/*************************
- * FUNCTIONS
- */
+#if LAB3_DUAL_CORE
 //-------------------------------------------
-// Function to connect to WiFi
-void connectWiFi() 
+// High-priority sensor/actuator task pinned to core 1
+void ioTask(void* arg)
 {
-  Serial.println("\nConnecting to WiFi...");
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
+  for (;;) {
+    ioStep();
+    vTaskDelay(1);
   }
-  
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
 }
 
+//-------------------------------------------
+// Network task pinned to core 0 (next to the WiFi stack)
+void netTask(void* arg)
+{
+  for (;;) {
+    netStep();
+    vTaskDelay(1);
+  }
+}
+
+#if NODE_HAS_LCD
+//-------------------------------------------
+// Low-priority LCD task pinned to core 1
+void displayTask(void* arg)
+{
+  for (;;) {
+    displayStep();
+    vTaskDelay(pdMS_TO_TICKS(displayRefreshMs));
+  }
+}
+#endif
+#endif
+
+/*************************
+ * FUNCTIONS
+ */
 //-------------------------------------------
 // Callback function for received MQTT messages
 void mqttCallback(char* topic, byte* payload, unsigned int length) 
 {
-  Serial.print("Message received on topic: ");
-  Serial.println(topic);
-
-  int chosenLED = -1;
-
-  String topicStr = String(topic);
-
-  if (topicStr == String(mqtt_topic_red)) {
-    chosenLED = redLEDPin;
-  } 
-  else if (topicStr == String(mqtt_topic_green)) {
-    chosenLED = greenLEDPin;
-  } 
-  else if (topicStr == String(mqtt_topic_blue)) {
-    chosenLED = blueLEDPin;
-    
-  } 
-  else if (topicStr == String(mqtt_topic_yellow)) {
-    chosenLED = yellowLEDPin;
+  LOG_DEBUG("Message received on topic: %s", topic);
+
+#if NODE_HAS_LEDS
+  const char* color = topicChild(topic, mqtt_topic_led_prefix);
+  bool handled = color != nullptr ? led_dispatcher.dispatch(color, payload, length)
+                                  : mqtt_dispatcher.dispatch(topic, payload, length);
+#else
+  bool handled = mqtt_dispatcher.dispatch(topic, payload, length);
+#endif
+  if (!handled) {
+    LOG_WARN("No handler for topic %s", topic);
   }
-  
-  // Convert payload to String
-  String message = "";
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-  Serial.print("Message content: ");
-  Serial.println(message);
-  Serial.println("---");
-  
+}
 
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message.c_str());
-  if (error) {
-    Serial.print("Failed to parse JSON: ");
-    Serial.println(error.c_str());
+#if NODE_HAS_LEDS
+//-------------------------------------------
+// Queues an LED command payload for led_channels[channel]
+void handleLedMessage(uint8_t* payload, unsigned int length, int channel)
+{
+  // Over the limit: dropped unread (counted in metrics)
+  if (!ledBuckets[channel].tryTake(millis())) {
     return;
   }
+  LOG_DEBUG("Message content: %.*s", (int)length, (const char*)payload);
 
-  // String state_val = "";
-  // if (doc.containsKey("state") == true) {
-  //   state_val = doc["state"].as<String>();
-  // }
+  // Empty payload: the dashboard cleared the retained per-LED state
+  if (length == 0) {
+    return;
+  }
 
-  const char* state_cstr = doc["state"].is<const char*>() ? doc["state"].as<const char*>() : nullptr;
-  String state_val = state_cstr ? String(state_cstr) : "";
+  // Parse {"state":"ON"|"OFF"} in place, straight from the MQTT buffer
+  JsonToken state;
+  if (!jsonFindString(payload, length, "state", state)) {
+    LOG_WARN("Failed to parse LED command");
+    return;
+  }
 
   int ledState = -1;
 
-  if (state_val == "ON"){
+  if (tokenEquals(state, "ON")){
     ledState = HIGH;
   }
-  else if (state_val == "OFF"){
+  else if (tokenEquals(state, "OFF")){
     ledState = LOW;
   }
 
-  if (chosenLED != -1 && ledState != -1) {
-    digitalWrite(chosenLED, ledState);
+  // The I/O side owns the outputs; netStep() forwards the latest state
+  if (ledState != -1) {
+    ledPending.add(ledChangeFor(led_channels[channel].pin, ledState == HIGH));
   }
- 
 }
 
 //-------------------------------------------
-// Function to connect/reconnect to MQTT broker
-void connectMQTT() 
+// Queues a combined command (see LedScene.h) for all LEDs at once; the I/O
+// side writes the whole change with one set and one clear register write
+void handleLedScene(uint8_t* payload, unsigned int length, int unused)
 {
-  while (!mqtt_client.connected()) {
-    Serial.println("Connecting to MQTT broker...");
-    
-    String client_id = "esp32-client-" + String(WiFi.macAddress());
-    
-    if (mqtt_client.connect(client_id.c_str(), mqtt_username, mqtt_password)) {
-      Serial.println("Connected to MQTT broker!");
-      
-      // Subscribe to topic
-      mqtt_client.subscribe(mqtt_topic_red);
-      mqtt_client.subscribe(mqtt_topic_green);
-      mqtt_client.subscribe(mqtt_topic_blue);
-      mqtt_client.subscribe(mqtt_topic_yellow);
-
-      Serial.println("Subscribed to topics");
-    } 
-    else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.println(mqtt_client.state());
-      Serial.println("Retrying in 5 seconds...");
-      delay(5000);
+  if (!ledBuckets[ledChannelCount].tryTake(millis())) {
+    return;
+  }
+  LOG_DEBUG("Message content: %.*s", (int)length, (const char*)payload);
+
+  LedChange change;
+  if (!parseLedScene(payload, length, led_channels, ledChannelCount, change)) {
+    LOG_WARN("Failed to parse LED scene");
+    return;
+  }
+  ledPending.add(change);
+}
+
+//-------------------------------------------
+// Total LED commands dropped over the rate limit
+uint32_t ledRateLimited()
+{
+  uint32_t total = 0;
+  for (const TokenBucket& bucket : ledBuckets) {
+    total += bucket.rejected();
+  }
+  return total;
+}
+#endif
+
+#if NODE_HAS_LCD
+//-------------------------------------------
+// Hands the text of a display message {"text":"..."} to displayStep(); an
+// unread text is simply replaced, so only the newest one is ever drawn
+void handleDisplayMessage(uint8_t* payload, unsigned int length, int unused)
+{
+  DisplayText message = {};
+
+  // Empty payload: the retained text was cleared, show a blank line
+  if (length > 0) {
+    JsonToken text;
+    if (!jsonFindString(payload, length, "text", text)) {
+      LOG_WARN("Failed to parse display message");
+      return;
     }
+    tokenCopy(text, message.text, sizeof(message.text));
+    for (char* c = message.text; *c; c++) {
+      if (*c < ' ' || *c > '~') {
+        *c = ' ';  // HD44780 character ROM is not UTF-8
+      }
+    }
+  }
+
+  if (uxQueueMessagesWaiting(displayQueue) > 0) {
+    displayCoalesced++;
   }
-}
\ No newline at end of file
+  xQueueOverwrite(displayQueue, &message);
+}
+#endif
+
+#if NODE_HAS_LEDS
+//-------------------------------------------
+// Forwards a benchmark ping {"seq":N,"state":"ON"|"OFF"} to the I/O side;
+// the pong {"seq":N,"rx_us":...,"act_us":...} is published from netStep()
+// once the LED has actually been written
+void handlePing(uint8_t* payload, unsigned int length, int channel)
+{
+  int64_t rxUs = esp_timer_get_time();
+  // Shares the yellow LED's bucket: a ping flood is dropped like a command
+  // flood (no pong, the client counts it lost)
+  if (!ledBuckets[channel].tryTake(millis())) {
+    return;
+  }
+
+  uint32_t seq;
+  JsonToken state;
+  if (!jsonFindUint(payload, length, "seq", seq) || seq == 0
+      || !jsonFindString(payload, length, "state", state)) {
+    LOG_WARN("Failed to parse bench ping");
+    return;
+  }
+
+  // Merged with any LED commands still pending, then sent at once (a ping
+  // is not held for the window) carrying the merged change, so the I/O side
+  // applies LED commands and pings for the same pin in arrival order
+  ledPending.add(ledChangeFor(led_channels[channel].pin, tokenEquals(state, "ON")));
+  LedCommand command = { { 0, 0 }, seq, rxUs };
+  ledPending.take(command.change);
+  ledFlushedAt = millis();
+  if (xQueueSend(ledQueue, &command, 0) != pdTRUE) {
+    ledPending.add(command.change);  // I/O side is behind; the ping is lost, the state is not
+  }
+}
+#endif
+
+#if NODE_HAS_OTA
+//-------------------------------------------
+// Hands a firmware update command to ota; the download runs in its own
+// task and is reported on mqtt_topic_ota_status from netStep()
+void handleOtaCommand(uint8_t* payload, unsigned int length, int unused)
+{
+  ota.handleCommand(payload, length);
+}
+#endif
+
+//-------------------------------------------
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed) 
+{
+  // The network is up: start SNTP for the wall clock (no-op after the first time)
+  sntpBegin();
+#if NODE_HAS_OTA
+  // Reaching the broker is what a new image has to prove (no-op otherwise)
+  ota.confirm();
+#endif
+
+  // The broker kept our subscriptions (and queued any QoS 1 commands)
+  if (sessionResumed) {
+    LOG_INFO("Session resumed, subscriptions kept");
+    return;
+  }
+
+  // QoS 1: commands published while we were offline are delivered on reconnect
+#if NODE_HAS_LEDS
+  mqtt.subscribe(mqtt_topic_leds, 1);  // every LED, however many there are
+  mqtt.subscribe(mqtt_topic_ping, 1);
+#endif
+#if NODE_HAS_LCD
+  mqtt.subscribe(mqtt_topic_display, 1);
+#endif
+#if NODE_HAS_OTA
+  mqtt.subscribe(mqtt_topic_ota, 1);
+#endif
+
+  LOG_INFO("Subscribed to topics");
+}
+
+//-------------------------------------------
+// wallClock is synced by netStep and read by displayStep on the other core
+Timebase telemetryTimebase()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&wallClockLock);
+  Timebase timebase = { wallClock.synced(), wallClock.epochMs(now), (uint32_t)now };
+  portEXIT_CRITICAL(&wallClockLock);
+  return timebase;
+}
+
+#if NODE_HAS_BUTTON
+//-------------------------------------------
+// GPIO interrupt on buttonPin (both edges)
+void IRAM_ATTR onButtonEdge()
+{
+  ButtonEdge edge;
+  edge.level = digitalRead(buttonPin);
+  edge.timeUs = esp_timer_get_time();
+  buttonEdges.push(edge);
+}
+#endif
\ No newline at end of file
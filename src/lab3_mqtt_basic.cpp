@@ -1,19 +1,27 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <PubSubClient.h>
+#include "ConnectionManager.h"
+#include "Log.h"
+
+// Written for the Wokwi simulator unless built with another NODE_PROFILE
+#ifndef NODE_PROFILE
+#define NODE_PROFILE NODE_PROFILE_WOKWI
+#endif
+#include "NodeConfig.h"
 
 
 // GLOBAL DECLARATIONS
 
 // WiFi credentials
-const char* ssid = "Wokwi-GUEST";
-const char* password = "";
+const char* ssid = NODE_WIFI_SSID;
+const char* password = NODE_WIFI_PASSWORD;
 
 // MQTT Broker settings
-const char* mqtt_broker = "mqtt.iotserver.uz";  // Free public MQTT broker
-const int mqtt_port = 1883;
-const char* mqtt_username = "userTTPU";  // username given in the telegram group
-const char* mqtt_password = "mqttpass";  // password given in the telegram group
+const char* mqtt_broker = NODE_MQTT_BROKER;
+const int mqtt_port = NODE_MQTT_PORT;
+const char* mqtt_username = NODE_MQTT_USERNAME;
+const char* mqtt_password = NODE_MQTT_PASSWORD;
 
 const char* mqtt_topic_pub = "ttpu/iot/test/out";   // Topic to publish
 const char* mqtt_topic_sub = "ttpu/iot/test/in";    // Topic to subscribe
@@ -21,17 +29,16 @@ const char* mqtt_topic_sub = "ttpu/iot/test/in";    // Topic to subscribe
 
 WiFiClient espClient;
 PubSubClient mqtt_client(espClient);
+ConnectionManager connection(espClient, mqtt_client);
 
 unsigned long lastPublishTime = 0;
 const long publishInterval = 5000;  // Publish every 5 seconds
 int messageCounter = 0;
 
-// Function to connect to WiFi
-void connectWiFi();
 // Callback function for received MQTT messages
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-// Function to connect/reconnect to MQTT broker
-void connectMQTT();
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed);
 
 /*************************
  * SETUP
@@ -39,19 +46,18 @@ void connectMQTT();
 void setup() {
   Serial.begin(115200);
   delay(1000);
+  logBegin();
   
-  Serial.println("\n===== MQTT Basic Example =====");
-  Serial.println("Your Name, Lab 3 - MQTT Basic");
-  
-  // Connect to WiFi
-  connectWiFi();
+  LOG_INFO("===== MQTT Basic Example =====");
+  LOG_INFO("Your Name, Lab 3 - MQTT Basic");
   
   // Setup MQTT
   mqtt_client.setServer(mqtt_broker, mqtt_port);
   mqtt_client.setCallback(mqttCallback);
+  connection.setOnConnected(onMqttConnected);
   
-  // Connect to MQTT broker
-  connectMQTT();
+  // Start WiFi + MQTT (connects in the background from loop())
+  connection.begin(ssid, password, mqtt_username, mqtt_password);
 }
 
 
@@ -59,20 +65,8 @@ void setup() {
  * LOOP
  */
 void loop() {
-  // Check WiFi connection
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi disconnected! Reconnecting...");
-    connectWiFi();
-  }
-  
-  // Check MQTT connection
-  if (!mqtt_client.connected()) {
-    Serial.println("MQTT disconnected! Reconnecting...");
-    connectMQTT();
-  }
-  
-  // Process incoming MQTT messages
-  mqtt_client.loop();
+  // Keep WiFi/MQTT up and process incoming messages (never blocks)
+  connection.loop();
   
   // Publish message every 5 seconds
   unsigned long currentTime = millis();
@@ -80,79 +74,40 @@ void loop() {
     lastPublishTime = currentTime;
     
     messageCounter++;
-    String message = "Hello from ESP32! Count: " + String(messageCounter);
+    char message[48];  // fixed buffer: no String churn on the heap
+    snprintf(message, sizeof(message), "Hello from ESP32! Count: %d", messageCounter);
     
-    Serial.print("Publishing message: ");
-    Serial.println(message);
+    LOG_INFO("Publishing message: %s", message);
     
-    if (mqtt_client.publish(mqtt_topic_pub, message.c_str())) {
-      Serial.println("Message published successfully!");
+    if (mqtt_client.publish(mqtt_topic_pub, message)) {
+      LOG_INFO("Message published successfully!");
     } 
     else {
-      Serial.println("Failed to publish message!");
+      LOG_WARN("Failed to publish message!");
     }
-    Serial.println("---");
   }
 }
 
 /*************************
  * FUNCTIONS
  */
-// Function to connect to WiFi
-void connectWiFi() 
-{
-  Serial.println("\nConnecting to WiFi...");
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(ssid, password);
-  
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
-}
-
 // Callback function for received MQTT messages
 void mqttCallback(char* topic, byte* payload, unsigned int length) 
 {
-  Serial.print("Message received on topic: ");
-  Serial.println(topic);
-  
-  // Convert payload to String
-  String message = "";
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
-  }
-  
-  Serial.print("Message content: ");
-  Serial.println(message);
-  Serial.println("---");
+  LOG_INFO("Message received on topic: %s", topic);
+  LOG_INFO("Message content: %.*s", (int)length, (const char*)payload);
 }
 
-// Function to connect/reconnect to MQTT broker
-void connectMQTT() 
+// Subscribes to topics each time the MQTT session comes up
+void onMqttConnected(PubSubClient& mqtt, bool sessionResumed) 
 {
-  while (!mqtt_client.connected()) {
-    Serial.println("Connecting to MQTT broker...");
-    
-    String client_id = "esp32-client-" + String(WiFi.macAddress());
-    
-    if (mqtt_client.connect(client_id.c_str(), mqtt_username, mqtt_password)) {
-      Serial.println("Connected to MQTT broker!");
-      
-      // Subscribe to topic
-      mqtt_client.subscribe(mqtt_topic_sub);
-      Serial.print("Subscribed to topic: ");
-      Serial.println(mqtt_topic_sub);
-    } 
-    else {
-      Serial.print("MQTT connection failed, rc=");
-      Serial.println(mqtt_client.state());
-      Serial.println("Retrying in 5 seconds...");
-      delay(5000);
-    }
+  // The broker kept our subscriptions (and queued any QoS 1 commands)
+  if (sessionResumed) {
+    LOG_INFO("Session resumed, subscriptions kept");
+    return;
   }
+
+  // QoS 1: commands published while we were offline are delivered on reconnect
+  mqtt.subscribe(mqtt_topic_sub, 1);
+  LOG_INFO("Subscribed to topic: %s", mqtt_topic_sub);
 }
\ No newline at end of file
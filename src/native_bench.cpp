@@ -0,0 +1,205 @@
+// Host-side microbenchmarks for the portable firmware logic ([env:native]).
+//
+//   pio run -e native -t exec            run all benchmarks
+//   .pio/build/native/program dispatch   run the ones whose name matches
+//
+// Numbers are per message / per call on the dev box; compare them before
+// and after a change to catch CPU-cost regressions without flashing.
+#include <stdio.h>
+#include <string.h>
+#include "MicroBench.h"
+#include "TopicDispatcher.h"
+#include "PayloadParser.h"
+#include "LedScene.h"
+#include "ButtonDebouncer.h"
+#include "SpscRing.h"
+#include "CalendarTime.h"
+#include "DeadbandFilter.h"
+#include "TelemetryBatch.h"
+#include "TelemetryCodec.h"
+
+using microbench::doNotOptimize;
+
+// One full-topic route per LED (the pre-wildcard lab3_ex3 layout)
+constexpr const char* topic_red = "ttpu/iot/maqsud/led/red";
+constexpr const char* topic_green = "ttpu/iot/maqsud/led/green";
+constexpr const char* topic_blue = "ttpu/iot/maqsud/led/blue";
+constexpr const char* topic_yellow = "ttpu/iot/maqsud/led/yellow";
+
+int handled = 0;
+void countMessage(uint8_t* payload, unsigned int length, int arg)
+{
+  handled += arg;
+}
+
+constexpr TopicRoute routes[] = {
+  { topicHash(topic_red),    topic_red,    countMessage, 26 },
+  { topicHash(topic_green),  topic_green,  countMessage, 27 },
+  { topicHash(topic_blue),   topic_blue,   countMessage, 14 },
+  { topicHash(topic_yellow), topic_yellow, countMessage, 12 },
+};
+
+// lab3_ex2/ex3 subscribe to led/+ and route on the last segment
+constexpr const char* led_prefix = "ttpu/iot/maqsud/led/";
+constexpr TopicRoute led_routes[] = {
+  { topicHash("red"),    "red",    countMessage, 26 },
+  { topicHash("green"),  "green",  countMessage, 27 },
+  { topicHash("blue"),   "blue",   countMessage, 14 },
+  { topicHash("yellow"), "yellow", countMessage, 12 },
+};
+
+constexpr LedChannel led_channels[] = {
+  { "red", 26 }, { "green", 27 }, { "blue", 14 }, { "yellow", 12 },
+};
+
+const char ledPayload[] = "{\"state\":\"ON\"}";
+const char scenePayload[] = "{\"red\":\"ON\",\"green\":\"OFF\",\"blue\":\"ON\",\"yellow\":\"OFF\"}";
+// Wall clock snapshot as taken after an SNTP sync
+constexpr Timebase synced = { true, 1736919000000LL, 0 };
+
+const char pingPayload[] = "{\"seq\":123456,\"state\":\"OFF\"}";
+
+//-------------------------------------------
+// Topic dispatch: hash the incoming topic, probe, strcmp the hit
+MICROBENCH(dispatchLedTopic)
+{
+  TopicDispatcher<16> dispatcher;
+  dispatcher.on(routes);
+  char topic[64];
+  strcpy(topic, topic_yellow);
+  uint8_t payload[sizeof(ledPayload)];
+  memcpy(payload, ledPayload, sizeof(ledPayload));
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(dispatcher.dispatch(topic, payload, sizeof(ledPayload) - 1));
+  }
+}
+
+MICROBENCH(dispatchLedWildcard)
+{
+  TopicDispatcher<16> dispatcher;
+  dispatcher.on(led_routes);
+  char topic[64];
+  strcpy(topic, topic_yellow);
+  uint8_t payload[sizeof(ledPayload)];
+  memcpy(payload, ledPayload, sizeof(ledPayload));
+  for (uint64_t i = 0; i < iterations; i++) {
+    const char* color = topicChild(topic, led_prefix);
+    doNotOptimize(color != nullptr && dispatcher.dispatch(color, payload, sizeof(ledPayload) - 1));
+  }
+}
+
+MICROBENCH(dispatchUnknownTopic)
+{
+  TopicDispatcher<16> dispatcher;
+  dispatcher.on(routes);
+  const char* topic = "ttpu/iot/maqsud/led/purple";
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(dispatcher.find(topic));
+  }
+}
+
+//-------------------------------------------
+// Payload parsing straight from the MQTT buffer
+MICROBENCH(parseLedState)
+{
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(ledPayload);
+  JsonToken state;
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(jsonFindString(payload, sizeof(ledPayload) - 1, "state", state));
+  }
+}
+
+MICROBENCH(parseLedScene)
+{
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(scenePayload);
+  LedChange change;
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(parseLedScene(payload, sizeof(scenePayload) - 1, led_channels, 4, change));
+  }
+}
+
+MICROBENCH(parsePingSeq)
+{
+  const uint8_t* payload = reinterpret_cast<const uint8_t*>(pingPayload);
+  uint32_t seq;
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(jsonFindUint(payload, sizeof(pingPayload) - 1, "seq", seq));
+  }
+}
+
+//-------------------------------------------
+// Button path: ISR ring + debouncer, one bouncy press per iteration
+MICROBENCH(debounceBouncyPress)
+{
+  SpscRing<ButtonEdge, 32> ring;
+  ButtonDebouncer debouncer(50000, 0);
+  int64_t t = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    uint8_t level = debouncer.level() ? 0 : 1;
+    for (int bounce = 0; bounce < 5; bounce++) {
+      ring.push({ (uint8_t)(bounce % 2 == 0 ? level : !level), t });
+      t += 200;
+    }
+    ring.push({ level, t });
+    ButtonEdge edge;
+    while (ring.pop(edge)) {
+      debouncer.addEdge(edge.level, edge.timeUs);
+    }
+    t += 60000;
+    doNotOptimize(debouncer.poll(t, edge));
+  }
+}
+
+//-------------------------------------------
+// Sensor path
+MICROBENCH(deadbandUpdate)
+{
+  DeadbandFilter filter(40, 30000);
+  uint16_t value = 2000;
+  for (uint64_t i = 0; i < iterations; i++) {
+    value = (uint16_t)(2000 + (i * 7) % 64);
+    doNotOptimize(filter.update(value, (unsigned long)(i * 20)));
+  }
+}
+
+MICROBENCH(encodeSensorBatch25)
+{
+  TelemetryBatch batch(25, 1000);
+  for (int i = 0; i < 25; i++) {
+    batch.push({ (uint16_t)(2000 + i), 1990, 2050, 2010, (uint32_t)(i * 20), 0 }, i * 20);  // seq set by push()
+  }
+  static uint8_t message[2048];
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(batch.encode(synced, message, sizeof(message)));
+  }
+}
+
+MICROBENCH(encodeButtonEvent)
+{
+  uint8_t message[64];
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(encodeButtonEvent(i & 1, (uint32_t)i, (uint32_t)i, synced, message, sizeof(message)));
+  }
+}
+
+//-------------------------------------------
+// LCD clock
+MICROBENCH(clockUpdateOneSecond)
+{
+  CalendarClock clock({ 2025, 1, 15, 10, 30, 0 }, 5 * 3600);
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(clock.update((unsigned long)(i * 1000)).second);
+  }
+}
+
+MICROBENCH(calendarFromEpochSeconds)
+{
+  for (uint64_t i = 0; i < iterations; i++) {
+    doNotOptimize(calendarFromEpoch(1736919000LL + (int64_t)(i & 0xFFFFFF)));
+  }
+}
+
+int main(int argc, char** argv)
+{
+  return microbench::runAll(argc, argv);
+}
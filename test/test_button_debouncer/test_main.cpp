@@ -0,0 +1,77 @@
+// ButtonDebouncer ([env:native]: pio test -e native)
+#include <unity.h>
+#include "ButtonDebouncer.h"
+
+namespace {
+const int64_t DEBOUNCE_US = 50000;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_clean_press_is_reported_after_the_quiet_time()
+{
+  ButtonDebouncer debouncer(DEBOUNCE_US, 0);
+  ButtonEdge edge;
+  debouncer.addEdge(1, 1000);
+  TEST_ASSERT_FALSE(debouncer.poll(1000 + DEBOUNCE_US - 1, edge));
+  TEST_ASSERT_TRUE(debouncer.poll(1000 + DEBOUNCE_US, edge));
+  TEST_ASSERT_EQUAL_UINT8(1, edge.level);
+  TEST_ASSERT_EQUAL_INT64(1000, edge.timeUs);
+  TEST_ASSERT_EQUAL_UINT8(1, debouncer.level());
+  TEST_ASSERT_FALSE(debouncer.poll(1000 + 2 * DEBOUNCE_US, edge));  // reported once
+}
+
+void test_bounce_is_stamped_with_the_first_edge()
+{
+  ButtonDebouncer debouncer(DEBOUNCE_US, 0);
+  ButtonEdge edge;
+  debouncer.addEdge(1, 10000);
+  debouncer.addEdge(0, 10200);
+  debouncer.addEdge(1, 10400);
+  debouncer.addEdge(0, 10600);
+  debouncer.addEdge(1, 10800);
+  // The window restarts with every bounce
+  TEST_ASSERT_FALSE(debouncer.poll(10000 + DEBOUNCE_US, edge));
+  TEST_ASSERT_TRUE(debouncer.poll(10800 + DEBOUNCE_US, edge));
+  TEST_ASSERT_EQUAL_UINT8(1, edge.level);
+  TEST_ASSERT_EQUAL_INT64(10000, edge.timeUs);
+}
+
+void test_glitch_back_to_the_stable_level_is_dropped()
+{
+  ButtonDebouncer debouncer(DEBOUNCE_US, 0);
+  ButtonEdge edge;
+  debouncer.addEdge(1, 0);
+  debouncer.addEdge(0, 300);
+  TEST_ASSERT_FALSE(debouncer.poll(300 + DEBOUNCE_US, edge));
+  TEST_ASSERT_EQUAL_UINT8(0, debouncer.level());
+
+  // Edges at the stable level alone start nothing
+  debouncer.addEdge(0, 100000);
+  TEST_ASSERT_FALSE(debouncer.poll(100000 + DEBOUNCE_US, edge));
+}
+
+void test_press_and_release()
+{
+  ButtonDebouncer debouncer(DEBOUNCE_US, 0);
+  ButtonEdge edge;
+  debouncer.addEdge(1, 0);
+  TEST_ASSERT_TRUE(debouncer.poll(DEBOUNCE_US, edge));
+  debouncer.addEdge(0, 200000);
+  debouncer.addEdge(1, 200100);
+  debouncer.addEdge(0, 200200);
+  TEST_ASSERT_TRUE(debouncer.poll(200200 + DEBOUNCE_US, edge));
+  TEST_ASSERT_EQUAL_UINT8(0, edge.level);
+  TEST_ASSERT_EQUAL_INT64(200000, edge.timeUs);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_clean_press_is_reported_after_the_quiet_time);
+  RUN_TEST(test_bounce_is_stamped_with_the_first_edge);
+  RUN_TEST(test_glitch_back_to_the_stable_level_is_dropped);
+  RUN_TEST(test_press_and_release);
+  return UNITY_END();
+}
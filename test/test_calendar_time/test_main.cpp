@@ -0,0 +1,104 @@
+// calendarFromEpoch() and CalendarClock ([env:native]: pio test -e native)
+#include <unity.h>
+#include "CalendarTime.h"
+
+namespace {
+void assertTime(const CalendarTime& expected, const CalendarTime& actual)
+{
+  TEST_ASSERT_EQUAL_INT(expected.year, actual.year);
+  TEST_ASSERT_EQUAL_INT(expected.month, actual.month);
+  TEST_ASSERT_EQUAL_INT(expected.day, actual.day);
+  TEST_ASSERT_EQUAL_INT(expected.hour, actual.hour);
+  TEST_ASSERT_EQUAL_INT(expected.minute, actual.minute);
+  TEST_ASSERT_EQUAL_INT(expected.second, actual.second);
+}
+
+const long TASHKENT = 5 * 3600;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_from_epoch_known_dates()
+{
+  assertTime({ 1970, 1, 1, 0, 0, 0 }, calendarFromEpoch(0));
+  assertTime({ 2000, 2, 29, 0, 0, 0 }, calendarFromEpoch(951782400LL));
+  assertTime({ 2024, 12, 31, 23, 59, 59 }, calendarFromEpoch(1735689599LL));
+  assertTime({ 1969, 12, 31, 23, 59, 59 }, calendarFromEpoch(-1));
+}
+
+void test_epoch_round_trip()
+{
+  // Dates and times across 1999-2101 (leap years, 2000 and 2100 included)
+  for (int64_t s = 915148800LL; s < 4133980800LL; s += 86400 + 3661) {
+    TEST_ASSERT_EQUAL_INT64(s, calendarToEpoch(calendarFromEpoch(s)));
+  }
+}
+
+void test_leap_years_and_month_lengths()
+{
+  TEST_ASSERT_TRUE(isLeapYear(2024));
+  TEST_ASSERT_TRUE(isLeapYear(2000));
+  TEST_ASSERT_FALSE(isLeapYear(2100));
+  TEST_ASSERT_FALSE(isLeapYear(2025));
+  TEST_ASSERT_EQUAL_INT(29, daysInMonth(2024, 2));
+  TEST_ASSERT_EQUAL_INT(28, daysInMonth(2100, 2));
+  TEST_ASSERT_EQUAL_INT(30, daysInMonth(2025, 4));
+  TEST_ASSERT_EQUAL_INT(31, daysInMonth(2025, 12));
+}
+
+void test_tick_carries_into_the_next_year()
+{
+  CalendarTime t = { 2024, 12, 31, 23, 59, 59 };
+  calendarTick(t);
+  assertTime({ 2025, 1, 1, 0, 0, 0 }, t);
+
+  t = { 2024, 2, 28, 23, 59, 59 };
+  calendarTick(t);
+  assertTime({ 2024, 2, 29, 0, 0, 0 }, t);
+}
+
+void test_clock_runs_from_the_start_time()
+{
+  CalendarClock clock({ 2025, 1, 15, 10, 30, 0 }, TASHKENT, 0);
+  TEST_ASSERT_FALSE(clock.synced());
+  assertTime({ 2025, 1, 15, 10, 30, 0 }, clock.update(999));
+  assertTime({ 2025, 1, 15, 10, 30, 1 }, clock.update(1000));
+  assertTime({ 2025, 1, 15, 10, 31, 1 }, clock.update(61500));
+  // A long gap is recomputed, not ticked
+  assertTime({ 2025, 1, 16, 10, 31, 1 }, clock.update(61500 + 86400000UL));
+  // Local start time minus the UTC offset
+  TEST_ASSERT_EQUAL_INT64(1736919000000LL, clock.epochMs(0));
+}
+
+void test_clock_follows_sync()
+{
+  CalendarClock clock({ 2025, 1, 15, 10, 30, 0 }, TASHKENT, 0);
+  // 2025-03-01 18:59:59.500 UTC, valid at millis() == 5000
+  clock.sync(1740855599500LL, 5000);
+  TEST_ASSERT_TRUE(clock.synced());
+  assertTime({ 2025, 3, 1, 23, 59, 59 }, clock.update(5000));
+  assertTime({ 2025, 3, 2, 0, 0, 0 }, clock.update(5500));
+  TEST_ASSERT_EQUAL_INT64(1740855601000LL, clock.epochMs(6500));
+  TEST_ASSERT_EQUAL_INT64(1740855599000LL, clock.epochMs(4500));  // before the sync
+}
+
+void test_clock_survives_millis_wraparound()
+{
+  unsigned long nearWrap = (unsigned long)-1500;
+  CalendarClock clock({ 2025, 1, 15, 10, 30, 0 }, TASHKENT, nearWrap);
+  assertTime({ 2025, 1, 15, 10, 30, 3 }, clock.update(nearWrap + 3000));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_from_epoch_known_dates);
+  RUN_TEST(test_epoch_round_trip);
+  RUN_TEST(test_leap_years_and_month_lengths);
+  RUN_TEST(test_tick_carries_into_the_next_year);
+  RUN_TEST(test_clock_runs_from_the_start_time);
+  RUN_TEST(test_clock_follows_sync);
+  RUN_TEST(test_clock_survives_millis_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,102 @@
+// parseLedScene() and LedCoalescer ([env:native]: pio test -e native)
+#include <string.h>
+#include <unity.h>
+#include "LedScene.h"
+
+namespace {
+constexpr LedChannel channels[] = {
+  { "red", 26 }, { "green", 27 }, { "blue", 14 }, { "yellow", 12 },
+};
+constexpr uint32_t RED = 1UL << 26;
+constexpr uint32_t GREEN = 1UL << 27;
+constexpr uint32_t BLUE = 1UL << 14;
+constexpr uint32_t YELLOW = 1UL << 12;
+
+bool parse(const char* json, LedChange& out)
+{
+  return parseLedScene(reinterpret_cast<const uint8_t*>(json), strlen(json), channels, 4, out);
+}
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_named_channels()
+{
+  LedChange change = { 0, 0 };
+  TEST_ASSERT_TRUE(parse("{\"red\":\"ON\",\"blue\":\"OFF\"}", change));
+  TEST_ASSERT_EQUAL_HEX32(RED, change.set);
+  TEST_ASSERT_EQUAL_HEX32(BLUE, change.clear);
+}
+
+void test_mask_sets_every_channel()
+{
+  LedChange change = { 0, 0 };
+  TEST_ASSERT_TRUE(parse("{\"mask\":5}", change));  // red and blue
+  TEST_ASSERT_EQUAL_HEX32(RED | BLUE, change.set);
+  TEST_ASSERT_EQUAL_HEX32(GREEN | YELLOW, change.clear);
+}
+
+void test_later_members_win()
+{
+  LedChange change = { 0, 0 };
+  TEST_ASSERT_TRUE(parse("{\"mask\":15,\"green\":\"OFF\"}", change));
+  TEST_ASSERT_EQUAL_HEX32(RED | BLUE | YELLOW, change.set);
+  TEST_ASSERT_EQUAL_HEX32(GREEN, change.clear);
+}
+
+void test_bad_scenes_leave_out_untouched()
+{
+  const char* cases[] = {
+    "{}", "{\"purple\":\"ON\"}", "{\"red\":\"on\"}", "{\"red\":1}", "{\"mask\":16}",
+    "{\"mask\":-1}", "{\"mask\":\"5\"}", "{\"red\":\"ON\",", "{\"red\":\"ON\",\"blue\":\"DIM\"}",
+  };
+  for (const char* json : cases) {
+    LedChange change = { 0xAA, 0x55 };
+    TEST_ASSERT_FALSE(parse(json, change));
+    TEST_ASSERT_EQUAL_HEX32(0xAA, change.set);
+    TEST_ASSERT_EQUAL_HEX32(0x55, change.clear);
+  }
+}
+
+void test_coalescer_keeps_the_latest_state_per_pin()
+{
+  LedCoalescer pending;
+  LedChange out;
+  TEST_ASSERT_FALSE(pending.take(out));
+
+  pending.add(ledChangeFor(26, true));
+  pending.add(ledChangeFor(14, true));
+  pending.add(ledChangeFor(26, false));  // overrides the pending ON
+  TEST_ASSERT_EQUAL_UINT32(1, pending.coalesced());
+
+  TEST_ASSERT_TRUE(pending.take(out));
+  TEST_ASSERT_EQUAL_HEX32(BLUE, out.set);
+  TEST_ASSERT_EQUAL_HEX32(RED, out.clear);
+  TEST_ASSERT_FALSE(pending.take(out));  // handed over in one piece
+}
+
+void test_coalescer_merges_scenes()
+{
+  LedCoalescer pending;
+  pending.add({ RED | GREEN, BLUE });
+  pending.add({ BLUE, RED });
+  TEST_ASSERT_EQUAL_UINT32(2, pending.coalesced());
+
+  LedChange out;
+  TEST_ASSERT_TRUE(pending.take(out));
+  TEST_ASSERT_EQUAL_HEX32(GREEN | BLUE, out.set);
+  TEST_ASSERT_EQUAL_HEX32(RED, out.clear);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_named_channels);
+  RUN_TEST(test_mask_sets_every_channel);
+  RUN_TEST(test_later_members_win);
+  RUN_TEST(test_bad_scenes_leave_out_untouched);
+  RUN_TEST(test_coalescer_keeps_the_latest_state_per_pin);
+  RUN_TEST(test_coalescer_merges_scenes);
+  return UNITY_END();
+}
@@ -0,0 +1,165 @@
+// FlatJsonReader, jsonFindString() and jsonFindUint() ([env:native]: pio test -e native)
+#include <string.h>
+#include <unity.h>
+#include "PayloadParser.h"
+
+namespace {
+const uint8_t* bytes(const char* text)
+{
+  return reinterpret_cast<const uint8_t*>(text);
+}
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_reader_walks_every_member()
+{
+  const char* json = " { \"state\" : \"ON\", \"seq\":42 ,\"rgb\":[1,{\"x\":\"]\"}],\"ok\":true,\"none\":null} ";
+  FlatJsonReader reader(bytes(json), strlen(json));
+  JsonToken key, value;
+
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_TRUE(tokenEquals(key, "state"));
+  TEST_ASSERT_TRUE(value.isString);
+  TEST_ASSERT_TRUE(tokenEquals(value, "ON"));
+
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_TRUE(tokenEquals(key, "seq"));
+  TEST_ASSERT_FALSE(value.isString);
+  TEST_ASSERT_TRUE(tokenEquals(value, "42"));
+
+  // Nested containers come back as one raw token, strings inside included
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_TRUE(tokenEquals(key, "rgb"));
+  TEST_ASSERT_TRUE(tokenEquals(value, "[1,{\"x\":\"]\"}]"));
+
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_TRUE(tokenEquals(value, "true"));
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_TRUE(tokenEquals(value, "null"));
+
+  TEST_ASSERT_FALSE(reader.next(key, value));
+  TEST_ASSERT_FALSE(reader.failed());
+}
+
+void test_reader_accepts_an_empty_object()
+{
+  FlatJsonReader reader(bytes("{ }"), 3);
+  JsonToken key, value;
+  TEST_ASSERT_FALSE(reader.next(key, value));
+  TEST_ASSERT_FALSE(reader.failed());
+}
+
+void test_reader_flags_malformed_input()
+{
+  const char* cases[] = {
+    "", "[]", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1 \"b\":2}", "{\"a\":\"open}", "{a:1}", "{\"a\":[1,2}",
+  };
+  for (const char* json : cases) {
+    FlatJsonReader reader(bytes(json), strlen(json));
+    JsonToken key, value;
+    while (reader.next(key, value)) {
+    }
+    TEST_ASSERT_TRUE(reader.failed());
+  }
+}
+
+void test_reader_stops_at_length()
+{
+  // Not NUL-terminated: the MQTT buffer continues past the payload
+  const char* buffer = "{\"state\":\"ON\"}garbage";
+  FlatJsonReader reader(bytes(buffer), 14);
+  JsonToken key, value;
+  TEST_ASSERT_TRUE(reader.next(key, value));
+  TEST_ASSERT_FALSE(reader.next(key, value));
+  TEST_ASSERT_FALSE(reader.failed());
+
+  FlatJsonReader cut(bytes(buffer), 12);
+  while (cut.next(key, value)) {
+  }
+  TEST_ASSERT_TRUE(cut.failed());
+}
+
+void test_find_string()
+{
+  const char* json = "{\"seq\":7,\"state\":\"OFF\",\"text\":\"a\\\"b\"}";
+  JsonToken value;
+  TEST_ASSERT_TRUE(jsonFindString(bytes(json), strlen(json), "state", value));
+  TEST_ASSERT_TRUE(tokenEquals(value, "OFF"));
+
+  // Escapes stay in the view; tokenCopy() resolves them
+  TEST_ASSERT_TRUE(jsonFindString(bytes(json), strlen(json), "text", value));
+  TEST_ASSERT_TRUE(tokenEquals(value, "a\\\"b"));
+  char text[8];
+  TEST_ASSERT_EQUAL(3, tokenCopy(value, text, sizeof(text)));
+  TEST_ASSERT_EQUAL_STRING("a\"b", text);
+
+  TEST_ASSERT_FALSE(jsonFindString(bytes(json), strlen(json), "seq", value));  // not a string
+  TEST_ASSERT_FALSE(jsonFindString(bytes(json), strlen(json), "missing", value));
+  TEST_ASSERT_FALSE(jsonFindString(bytes("state:ON"), 8, "state", value));
+}
+
+void test_token_copy_truncates()
+{
+  const char* json = "{\"text\":\"Hello, LCD\"}";
+  JsonToken value;
+  TEST_ASSERT_TRUE(jsonFindString(bytes(json), strlen(json), "text", value));
+  char out[6];
+  TEST_ASSERT_EQUAL(5, tokenCopy(value, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("Hello", out);
+}
+
+void test_find_uint()
+{
+  const char* json = "{\"seq\":123456,\"max\":4294967295,\"big\":4294967296,\"neg\":-1,"
+                     "\"frac\":1.5,\"str\":\"7\"}";
+  size_t n = strlen(json);
+  uint32_t value = 0;
+  TEST_ASSERT_TRUE(jsonFindUint(bytes(json), n, "seq", value));
+  TEST_ASSERT_EQUAL_UINT32(123456, value);
+  TEST_ASSERT_TRUE(jsonFindUint(bytes(json), n, "max", value));
+  TEST_ASSERT_EQUAL_UINT32(4294967295u, value);
+
+  value = 99;
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(json), n, "big", value));
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(json), n, "neg", value));
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(json), n, "frac", value));
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(json), n, "str", value));
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(json), n, "missing", value));
+  TEST_ASSERT_EQUAL_UINT32(99, value);  // untouched on failure
+}
+
+void test_find_rejects_malformed_after_the_match()
+{
+  JsonToken value;
+  uint32_t number = 99;
+  const char* cases[] = {
+    "{\"state\":\"ON\",garbage", "{\"state\":\"ON\"", "{\"state\":\"ON\",\"seq\":}",
+  };
+  for (const char* json : cases) {
+    TEST_ASSERT_FALSE(jsonFindString(bytes(json), strlen(json), "state", value));
+  }
+  const char* truncated = "{\"seq\":7,\"state\":\"O";
+  TEST_ASSERT_FALSE(jsonFindUint(bytes(truncated), strlen(truncated), "seq", number));
+  TEST_ASSERT_EQUAL_UINT32(99, number);
+
+  // The first member of that name counts, wherever it is
+  const char* twice = "{\"state\":\"ON\",\"state\":\"OFF\"}";
+  TEST_ASSERT_TRUE(jsonFindString(bytes(twice), strlen(twice), "state", value));
+  TEST_ASSERT_TRUE(tokenEquals(value, "ON"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_reader_walks_every_member);
+  RUN_TEST(test_reader_accepts_an_empty_object);
+  RUN_TEST(test_reader_flags_malformed_input);
+  RUN_TEST(test_reader_stops_at_length);
+  RUN_TEST(test_find_string);
+  RUN_TEST(test_token_copy_truncates);
+  RUN_TEST(test_find_uint);
+  RUN_TEST(test_find_rejects_malformed_after_the_match);
+  return UNITY_END();
+}
@@ -0,0 +1,60 @@
+// TokenBucket ([env:native]: pio test -e native)
+#include <unity.h>
+#include "TokenBucket.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_burst_then_reject()
+{
+  TokenBucket bucket(3, 100);
+  TEST_ASSERT_TRUE(bucket.tryTake(0));
+  TEST_ASSERT_TRUE(bucket.tryTake(0));
+  TEST_ASSERT_TRUE(bucket.tryTake(0));
+  TEST_ASSERT_FALSE(bucket.tryTake(0));
+  TEST_ASSERT_FALSE(bucket.tryTake(99));
+  TEST_ASSERT_EQUAL_UINT32(2, bucket.rejected());
+}
+
+void test_refills_one_token_per_period()
+{
+  TokenBucket bucket(2, 100);
+  bucket.tryTake(0);
+  bucket.tryTake(0);
+  TEST_ASSERT_TRUE(bucket.tryTake(100));
+  TEST_ASSERT_FALSE(bucket.tryTake(150));
+  // Fractional progress is kept: the next token is due at 200, not 250
+  TEST_ASSERT_TRUE(bucket.tryTake(200));
+  TEST_ASSERT_FALSE(bucket.tryTake(299));
+}
+
+void test_refill_is_capped_at_burst()
+{
+  TokenBucket bucket(2, 100);
+  bucket.tryTake(0);
+  bucket.tryTake(0);
+  int accepted = 0;
+  for (int i = 0; i < 5; i++) {
+    accepted += bucket.tryTake(10000) ? 1 : 0;
+  }
+  TEST_ASSERT_EQUAL(2, accepted);
+}
+
+void test_survives_millis_wraparound()
+{
+  TokenBucket bucket(1, 100);
+  unsigned long nearWrap = (unsigned long)-50;
+  TEST_ASSERT_TRUE(bucket.tryTake(nearWrap));
+  TEST_ASSERT_FALSE(bucket.tryTake(nearWrap + 20));
+  TEST_ASSERT_TRUE(bucket.tryTake(nearWrap + 100));  // past the wrap
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_then_reject);
+  RUN_TEST(test_refills_one_token_per_period);
+  RUN_TEST(test_refill_is_capped_at_burst);
+  RUN_TEST(test_survives_millis_wraparound);
+  return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// DeadbandFilter and the packed TelemetryCodec layouts ([env:native]: pio test -e native)
+#include <unity.h>
+#include "DeadbandFilter.h"
+#include "TelemetryBatch.h"
+#include "TelemetryCodec.h"
+
+namespace {
+// Little-endian readers, as client/app.py decodes the packed records
+uint64_t getLE(const uint8_t*& p, int bytes)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) {
+    v |= (uint64_t)*p++ << (8 * i);
+  }
+  return v;
+}
+
+constexpr Timebase synced = { true, 1736919000000LL, 500 };
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_deadband_reports_first_value_and_big_moves()
+{
+  DeadbandFilter filter(40, 30000);
+  TEST_ASSERT_TRUE(filter.update(2000, 0));
+  TEST_ASSERT_FALSE(filter.update(2039, 20));
+  TEST_ASSERT_FALSE(filter.update(1961, 40));
+  TEST_ASSERT_TRUE(filter.update(2040, 60));
+  // The reported value is the new reference
+  TEST_ASSERT_FALSE(filter.update(2079, 80));
+  TEST_ASSERT_TRUE(filter.update(2000, 100));
+  TEST_ASSERT_EQUAL_UINT32(3, filter.suppressed());
+}
+
+void test_deadband_heartbeat()
+{
+  DeadbandFilter filter(40, 30000);
+  filter.update(2000, 1000);
+  TEST_ASSERT_FALSE(filter.update(2001, 30999));
+  TEST_ASSERT_TRUE(filter.update(2001, 31000));
+  TEST_ASSERT_FALSE(filter.update(2001, 31020));
+}
+
+void test_timebase()
+{
+  TEST_ASSERT_EQUAL_INT64(1736919000000LL, synced.toEpoch(500));
+  TEST_ASSERT_EQUAL_INT64(1736918999900LL, synced.toEpoch(400));  // before the snapshot
+  constexpr Timebase uptime = { false, 0, 0 };
+  TEST_ASSERT_EQUAL_INT64(1234, uptime.toEpoch(1234));
+}
+
+void test_packed_light_batch_round_trip()
+{
+  TelemetryBatch batch(25, 1000);
+  batch.setNextSeq(41);
+  for (uint32_t i = 0; i < 30; i++) {
+    batch.push({ (uint16_t)(2000 + i), (uint16_t)(1900 + i), (uint16_t)(4095 - i), (uint16_t)(2010 + i),
+                 600 + i * 20, 0 }, 600 + i * 20);
+  }
+
+  uint8_t message[15 + 25 * 12];
+  TEST_ASSERT_EQUAL(0, batch.encodePacked(synced, message, sizeof(message) - 1));
+  size_t length = batch.encodePacked(synced, message, sizeof(message));
+  TEST_ASSERT_EQUAL(sizeof(message), length);
+
+  const uint8_t* p = message;
+  TEST_ASSERT_EQUAL_UINT8(PACKED_MAGIC, getLE(p, 1));
+  TEST_ASSERT_EQUAL_UINT8(PACKED_LIGHT_BATCH, getLE(p, 1));
+  size_t count = getLE(p, 1);
+  TEST_ASSERT_EQUAL(25, count);  // batchSize(), not everything queued
+  uint32_t firstSeq = getLE(p, 4);
+  int64_t firstTimestamp = (int64_t)getLE(p, 8);
+  TEST_ASSERT_EQUAL_UINT32(41, firstSeq);
+  TEST_ASSERT_EQUAL_INT64(synced.toEpoch(600), firstTimestamp);
+
+  for (size_t i = 0; i < count; i++) {
+    const LightSample& sample = batch.at(i);
+    TEST_ASSERT_EQUAL_UINT16(sample.light, getLE(p, 2));
+    TEST_ASSERT_EQUAL_UINT16(sample.min, getLE(p, 2));
+    TEST_ASSERT_EQUAL_UINT16(sample.max, getLE(p, 2));
+    TEST_ASSERT_EQUAL_UINT16(sample.ema, getLE(p, 2));
+    TEST_ASSERT_EQUAL_INT64(synced.toEpoch(sample.timestamp), firstTimestamp + (int64_t)getLE(p, 4));
+    TEST_ASSERT_EQUAL_UINT32(sample.seq, firstSeq + i);
+  }
+  TEST_ASSERT_EQUAL_PTR(message + length, p);
+
+  // The next message carries the rest, numbered on
+  batch.pop(count);
+  length = batch.encodePacked(synced, message, sizeof(message));
+  TEST_ASSERT_EQUAL(15 + 5 * 12, length);
+  p = message + 3;
+  TEST_ASSERT_EQUAL_UINT32(66, getLE(p, 4));
+}
+
+void test_batch_age_after_partial_pop()
+{
+  TelemetryBatch batch(25, 1000);
+  for (uint32_t i = 0; i < 30; i++) {
+    batch.push({ 2000, 2000, 2000, 2000, i * 20, 0 }, i * 20);
+  }
+  TEST_ASSERT_TRUE(batch.due(580));
+  batch.pop(batch.batchSize());
+
+  // The 5 left over were queued at 500..580: due by age from 1500, not now
+  TEST_ASSERT_EQUAL(5, batch.size());
+  TEST_ASSERT_FALSE(batch.due(600));
+  TEST_ASSERT_FALSE(batch.due(1499));
+  TEST_ASSERT_TRUE(batch.due(1500));
+}
+
+void test_batch_age_after_overwrite()
+{
+  TelemetryBatch batch(TelemetryBatch::CAPACITY, 1000);
+  for (uint32_t i = 0; i < TelemetryBatch::CAPACITY; i++) {
+    TEST_ASSERT_TRUE(batch.push({ 2000, 2000, 2000, 2000, i * 10, 0 }, i * 10));
+  }
+  TEST_ASSERT_FALSE(batch.push({ 2000, 2000, 2000, 2000, 5000, 0 }, 5000));
+  TEST_ASSERT_FALSE(batch.push({ 2000, 2000, 2000, 2000, 5010, 0 }, 5010));
+
+  // Samples 0 and 1 are gone; once one more is published the oldest left
+  // was queued at 30
+  TEST_ASSERT_EQUAL_UINT32(2, batch.at(0).seq);
+  batch.pop(1);
+  TEST_ASSERT_FALSE(batch.due(1029));
+  TEST_ASSERT_TRUE(batch.due(1030));
+}
+
+void test_packed_batch_needs_samples()
+{
+  TelemetryBatch batch(25, 1000);
+  uint8_t message[64];
+  TEST_ASSERT_EQUAL(0, batch.encodePacked(synced, message, sizeof(message)));
+}
+
+void test_packed_button_event_round_trip()
+{
+  uint8_t message[15];
+  TEST_ASSERT_EQUAL(0, encodePackedButtonEvent(true, 7, 1736919000123LL, message, sizeof(message) - 1));
+  TEST_ASSERT_EQUAL(15, encodePackedButtonEvent(true, 7, 1736919000123LL, message, sizeof(message)));
+
+  const uint8_t* p = message;
+  TEST_ASSERT_EQUAL_UINT8(PACKED_MAGIC, getLE(p, 1));
+  TEST_ASSERT_EQUAL_UINT8(PACKED_BUTTON_EVENT, getLE(p, 1));
+  TEST_ASSERT_EQUAL_UINT8(1, getLE(p, 1));
+  TEST_ASSERT_EQUAL_UINT32(7, getLE(p, 4));
+  TEST_ASSERT_EQUAL_INT64(1736919000123LL, (int64_t)getLE(p, 8));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_deadband_reports_first_value_and_big_moves);
+  RUN_TEST(test_deadband_heartbeat);
+  RUN_TEST(test_timebase);
+  RUN_TEST(test_packed_light_batch_round_trip);
+  RUN_TEST(test_batch_age_after_partial_pop);
+  RUN_TEST(test_batch_age_after_overwrite);
+  RUN_TEST(test_packed_batch_needs_samples);
+  RUN_TEST(test_packed_button_event_round_trip);
+  return UNITY_END();
+}
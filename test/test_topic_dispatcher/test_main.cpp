@@ -0,0 +1,134 @@
+// TopicDispatcher and topicChild() ([env:native]: pio test -e native)
+#include <unity.h>
+#include "TopicDispatcher.h"
+
+namespace {
+int lastArg = 0;
+unsigned int lastLength = 0;
+int calls = 0;
+
+void record(uint8_t*, unsigned int length, int arg)
+{
+  lastArg = arg;
+  lastLength = length;
+  calls++;
+}
+
+void recordNegated(uint8_t* payload, unsigned int length, int arg)
+{
+  record(payload, length, -arg);
+}
+
+constexpr const char* topic_red = "ttpu/iot/maqsud/led/red";
+constexpr const char* topic_blue = "ttpu/iot/maqsud/led/blue";
+
+constexpr TopicRoute routes[] = {
+  { topicHash(topic_red),  topic_red,  record, 26 },
+  { topicHash(topic_blue), topic_blue, record, 14 },
+};
+}
+
+void setUp()
+{
+  lastArg = 0;
+  lastLength = 0;
+  calls = 0;
+}
+
+void tearDown() {}
+
+void test_hash_is_fnv1a()
+{
+  TEST_ASSERT_EQUAL_HEX32(2166136261u, topicHash(""));
+  TEST_ASSERT_EQUAL_HEX32(0xE40C292Cu, topicHash("a"));
+  static_assert(topicHash("red") != topicHash("blue"), "hashed at compile time");
+}
+
+void test_dispatch_calls_the_registered_handler()
+{
+  TopicDispatcher<8> dispatcher;
+  TEST_ASSERT_TRUE(dispatcher.on(routes));
+  TEST_ASSERT_EQUAL(2, dispatcher.size());
+
+  char topic[] = "ttpu/iot/maqsud/led/blue";
+  uint8_t payload[] = "{}";
+  TEST_ASSERT_TRUE(dispatcher.dispatch(topic, payload, 2));
+  TEST_ASSERT_EQUAL(1, calls);
+  TEST_ASSERT_EQUAL(14, lastArg);
+  TEST_ASSERT_EQUAL(2, lastLength);
+}
+
+void test_unknown_topic_is_not_dispatched()
+{
+  TopicDispatcher<8> dispatcher;
+  dispatcher.on(routes);
+  uint8_t payload[] = "{}";
+  TEST_ASSERT_FALSE(dispatcher.dispatch("ttpu/iot/maqsud/led/purple", payload, 2));
+  TEST_ASSERT_FALSE(dispatcher.dispatch("ttpu/iot/maqsud/led", payload, 2));
+  TEST_ASSERT_NULL(dispatcher.find(""));
+  TEST_ASSERT_EQUAL(0, calls);
+}
+
+void test_reregistering_replaces_the_handler()
+{
+  TopicDispatcher<8> dispatcher;
+  dispatcher.on(routes);
+  TEST_ASSERT_TRUE(dispatcher.on({ topicHash(topic_red), topic_red, recordNegated, 5 }));
+  TEST_ASSERT_EQUAL(2, dispatcher.size());
+
+  uint8_t payload[] = "";
+  dispatcher.dispatch(topic_red, payload, 0);
+  TEST_ASSERT_EQUAL(-5, lastArg);
+}
+
+void test_colliding_slots_are_probed()
+{
+  // "red", "green" and "all" all hash to slot 4 of 8
+  TopicDispatcher<8> dispatcher;
+  dispatcher.on({ topicHash("red"),   "red",   record, 1 });
+  dispatcher.on({ topicHash("green"), "green", record, 2 });
+  dispatcher.on({ topicHash("all"),   "all",   record, 3 });
+
+  uint8_t payload[] = "";
+  TEST_ASSERT_TRUE(dispatcher.dispatch("all", payload, 0));
+  TEST_ASSERT_EQUAL(3, lastArg);
+  TEST_ASSERT_TRUE(dispatcher.dispatch("green", payload, 0));
+  TEST_ASSERT_EQUAL(2, lastArg);
+  TEST_ASSERT_TRUE(dispatcher.dispatch("red", payload, 0));
+  TEST_ASSERT_EQUAL(1, lastArg);
+  TEST_ASSERT_NULL(dispatcher.find("blue"));
+}
+
+void test_table_keeps_one_slot_free()
+{
+  TopicDispatcher<4> dispatcher;
+  TEST_ASSERT_TRUE(dispatcher.on({ topicHash("a"), "a", record, 1 }));
+  TEST_ASSERT_TRUE(dispatcher.on({ topicHash("b"), "b", record, 2 }));
+  TEST_ASSERT_TRUE(dispatcher.on({ topicHash("c"), "c", record, 3 }));
+  TEST_ASSERT_FALSE(dispatcher.on({ topicHash("d"), "d", record, 4 }));
+  TEST_ASSERT_EQUAL(3, dispatcher.size());
+  TEST_ASSERT_NULL(dispatcher.find("d"));  // probing still ends on the free slot
+}
+
+void test_topic_child_returns_the_last_segment()
+{
+  const char* prefix = "ttpu/iot/maqsud/led/";
+  TEST_ASSERT_EQUAL_STRING("red", topicChild("ttpu/iot/maqsud/led/red", prefix));
+  TEST_ASSERT_NULL(topicChild("ttpu/iot/maqsud/led/", prefix));          // no segment
+  TEST_ASSERT_NULL(topicChild("ttpu/iot/maqsud/led/red/x", prefix));     // two levels
+  TEST_ASSERT_NULL(topicChild("ttpu/iot/maqsud/display", prefix));       // other branch
+  TEST_ASSERT_NULL(topicChild("ttpu/iot/maqsud/led", prefix));           // prefix cut short
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_hash_is_fnv1a);
+  RUN_TEST(test_dispatch_calls_the_registered_handler);
+  RUN_TEST(test_unknown_topic_is_not_dispatched);
+  RUN_TEST(test_reregistering_replaces_the_handler);
+  RUN_TEST(test_colliding_slots_are_probed);
+  RUN_TEST(test_table_keeps_one_slot_free);
+  RUN_TEST(test_topic_child_returns_the_last_segment);
+  return UNITY_END();
+}